@@ -0,0 +1,97 @@
+#include <sol.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// allocations per operation for every api primitive once warmed up, split between the Lua
+// allocator and global operator new; one CSV line per primitive. test_allocations fails
+// when one of the paths it declares allocation free starts allocating
+
+SOL_COUNT_NEW_ALLOCATIONS
+
+namespace {
+struct counter {
+    int x = 0;
+    int a_rather_long_member_name = 0;
+
+    int add(int value) {
+        x += value;
+        return x;
+    }
+};
+
+int add(int a, int b) {
+    return a + b;
+}
+
+const int operations = 1000;
+
+template<typename Fx>
+void report(sol::allocation_counter& allocations, const char* primitive, Fx&& fx) {
+    for(int i = 0; i < operations; ++i) {
+        fx();
+    }
+    sol::allocation_count count = allocations.measure([&] {
+        for(int i = 0; i < operations; ++i) {
+            fx();
+        }
+    });
+    std::cout << primitive << ',' << operations << ','
+              << static_cast<double>(count.lua_allocations) / operations << ','
+              << static_cast<double>(count.lua_bytes) / operations << ','
+              << static_cast<double>(count.cpp_allocations) / operations << ','
+              << static_cast<double>(count.cpp_bytes) / operations << '\n';
+}
+} // anonymous
+
+int main() {
+    try {
+        sol::allocation_counter allocations;
+        sol::state lua(allocations);
+        lua.open_libraries(sol::lib::base);
+
+        int offset = 1;
+        lua.set_function("add", &add);
+        lua.set_function("add_offset", [offset](int a, int b) { return a + b + offset; });
+        lua.new_userdata<counter>("counter", "add", &counter::add, "x", &counter::x,
+                                  "a_rather_long_member_name", &counter::a_rather_long_member_name);
+        lua.script("obj = counter.new()\n"
+                   "count = 1\n"
+                   "name = 'a string too long for the small string buffer'\n"
+                   "function square(x) return x * x end\n"
+                   "function free_function() add(1, 2) end\n"
+                   "function lambda() add_offset(1, 2) end\n"
+                   "function member_function() obj:add(1) end\n"
+                   "function member_get() local x = obj.x end\n"
+                   "function member_set() obj.x = 2 end\n"
+                   "function long_member_get() local x = obj.a_rather_long_member_name end");
+
+        std::cout << "primitive,operations,lua_allocations,lua_bytes,cpp_allocations,cpp_bytes\n";
+        for(auto&& name : { "free_function", "lambda", "member_function", "member_get", "member_set", "long_member_get" }) {
+            sol::function fx = lua.get<sol::function>(name);
+            report(allocations, name, [&] { fx(); });
+        }
+
+        sol::table table = lua.create_table();
+        sol::function square = lua.get<sol::function>("square");
+        std::vector<int> values(16);
+        int sink = 0;
+        report(allocations, "table_set_string", [&] { table.set("key", 1); });
+        report(allocations, "table_get_string", [&] { sink += table.get<int>("key"); });
+        report(allocations, "table_set_integer", [&] { table.set(3, 1); });
+        report(allocations, "table_get_integer", [&] { sink += table.get<int>(3); });
+        report(allocations, "global_get", [&] { sink += lua.get<int>("count"); });
+        report(allocations, "get_std_string", [&] { sink += static_cast<int>(lua.get<std::string>("name").size()); });
+        report(allocations, "get_function", [&] { lua.get<sol::function>("square"); });
+        report(allocations, "function_call", [&] { sink += square.call<int>(3); });
+        report(allocations, "reference_copy", [&] { sol::function copy = square; });
+        report(allocations, "create_table", [&] { lua.create_table(); });
+        report(allocations, "container_push", [&] { lua.set("values", values); });
+        report(allocations, "script", [&] { lua.script("local x = 1"); });
+        std::cerr << "checksum " << sink << '\n';
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
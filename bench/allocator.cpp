@@ -0,0 +1,92 @@
+#include <sol.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// compares the default allocator against sol::pool_allocator on
+// allocation heavy workloads, first on one thread then on every core
+
+struct particle {
+    double x = 0, y = 0;
+
+    void move(double dx, double dy) {
+        x += dx;
+        y += dy;
+    }
+};
+
+const char* const workloads[][2] = {
+    { "strings", "local t = {} for i = 1, 20000 do t[#t + 1] = 'key' .. i .. '_' .. (i * 3) end" },
+    { "tables", "for i = 1, 20000 do local t = { i, i + 1, x = i, y = { i } } end" },
+    { "closures", "local fs = {} for i = 1, 20000 do fs[i % 64 + 1] = function() return i end end" },
+    { "userdata", "for i = 1, 20000 do local p = particle.new() p:move(i, i) end" }
+};
+
+void setup(sol::state& lua) {
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<particle>("particle", "move", &particle::move);
+}
+
+template<typename Fx>
+double run(Fx&& fx, int repetitions) {
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < repetitions; ++i) {
+        fx();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+double workload_default(const char* code, int repetitions) {
+    return run([code] {
+        sol::state lua;
+        setup(lua);
+        lua.script(code);
+    }, repetitions);
+}
+
+double workload_pool(const char* code, int repetitions) {
+    return run([code] {
+        sol::pool_allocator pool;
+        sol::state lua(pool);
+        setup(lua);
+        lua.script(code);
+    }, repetitions);
+}
+
+template<typename Fx>
+double threaded(Fx&& fx, unsigned threads) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(fx);
+    }
+    for(auto&& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main() {
+    const int repetitions = 20;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << std::left << std::setw(10) << "workload" << std::setw(8) << "threads"
+              << std::setw(14) << "default (ms)" << std::setw(14) << "pool (ms)" << "speedup\n";
+
+    for(auto&& workload : workloads) {
+        const char* name = workload[0];
+        const char* code = workload[1];
+        for(unsigned t = 1; t <= threads; t = t == threads ? threads + 1 : threads) {
+            double base = threaded([=] { workload_default(code, repetitions); }, t);
+            double pooled = threaded([=] { workload_pool(code, repetitions); }, t);
+            std::cout << std::setw(10) << name << std::setw(8) << t
+                      << std::setw(14) << base << std::setw(14) << pooled << base / pooled << '\n';
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include <sol.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// per-request sandbox latency: create a state, run a request, close it
+// compares the default allocator against a reused arena
+
+const char* const request =
+    "local items = {}\n"
+    "for i = 1, 2000 do items[i] = { id = i, name = 'item' .. i } end\n"
+    "local total = 0\n"
+    "for _, item in ipairs(items) do total = total + #item.name end\n"
+    "result = total";
+
+struct session {
+    int id = 0;
+};
+
+template<typename State, typename... Args>
+void handle(Args&&... args) {
+    State lua(std::forward<Args>(args)...);
+    lua.open_libraries(sol::lib::base);
+    lua.template new_userdata<session>("session");
+    lua.script(request);
+}
+
+template<typename Fx>
+void report(const char* name, Fx&& fx) {
+    const int requests = 2000;
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    for(int i = 0; i < requests; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fx();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        latencies.push_back(elapsed.count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::left << std::setw(16) << name
+              << std::setw(12) << latencies[requests / 2]
+              << std::setw(12) << latencies[requests * 99 / 100]
+              << latencies.back() << '\n';
+}
+
+int main() {
+    std::cout << std::left << std::setw(16) << "allocator" << std::setw(12) << "p50 (us)"
+              << std::setw(12) << "p99 (us)" << "max (us)\n";
+
+    report("default", [] {
+        handle<sol::state>();
+    });
+
+    report("arena_state", [] {
+        handle<sol::arena_state>();
+    });
+
+    sol::arena_allocator arena;
+    report("reused arena", [&arena] {
+        handle<sol::state>(arena);
+        arena.reset();
+    });
+}
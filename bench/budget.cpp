@@ -0,0 +1,52 @@
+#include <sol.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// cost of running a script under an execution budget at different check granularities
+
+const char* const workload =
+    "local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end\n"
+    "local total = 0\n"
+    "for i = 1, 200000 do total = total + i % 7 end\n"
+    "result = fib(25) + total";
+
+template<typename Fx>
+double measure(Fx&& fx) {
+    const int runs = 5;
+    double best = 0;
+    for(int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fx();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if(i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+int main() {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.script(workload);
+
+    double baseline = measure([&] {
+        lua.script(workload);
+    });
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(14) << "granularity" << std::setw(12) << "time (ms)" << "overhead\n";
+    std::cout << std::left << std::setw(14) << "none" << std::setw(12) << baseline << "-\n";
+
+    sol::execution_budget budget(lua.lua_state());
+    budget.deadline(std::chrono::seconds(60));
+    for(int granularity : { 1, 10, 100, 1000, 10000, 100000 }) {
+        budget.granularity(granularity);
+        double time = measure([&] {
+            budget.run([&] { lua.script(workload); });
+        });
+        std::cout << std::left << std::setw(14) << granularity << std::setw(12) << time
+                  << (time / baseline - 1) * 100 << "%\n";
+    }
+}
@@ -0,0 +1,55 @@
+#include <sol.hpp>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// memory per tenant: a full state each versus one environment each inside a shared state
+
+const char* const tenant_script =
+    "settings = { name = 'tenant', limit = 100 }\n"
+    "function on_event(e) return e + settings.limit end\n"
+    "counter = 0";
+
+struct session {
+    int id = 0;
+    int get() const { return id; }
+};
+
+void setup(sol::state& lua) {
+    lua.open_libraries(sol::lib::base, sol::lib::string, sol::lib::table, sol::lib::math);
+    lua.new_userdata<session>("session", "get", &session::get);
+}
+
+void report(const char* name, int tenants, std::size_t bytes) {
+    std::cout << std::left << std::setw(16) << name << std::setw(10) << tenants
+              << std::setw(14) << bytes << bytes / tenants << '\n';
+}
+
+int main() {
+    std::cout << std::left << std::setw(16) << "isolation" << std::setw(10) << "tenants"
+              << std::setw(14) << "bytes" << "bytes/tenant\n";
+
+    for(int tenants : { 10, 100, 1000 }) {
+        sol::memory_tracker tracker;
+        {
+            std::vector<std::unique_ptr<sol::state>> states;
+            for(int i = 0; i < tenants; ++i) {
+                states.emplace_back(new sol::state(tracker));
+                setup(*states.back());
+                states.back()->script(tenant_script);
+            }
+            report("state", tenants, tracker.current());
+        }
+
+        sol::state lua;
+        setup(lua);
+        std::size_t base = lua.memory_used();
+        std::vector<sol::environment> environments;
+        for(int i = 0; i < tenants; ++i) {
+            environments.push_back(lua.create_environment());
+            lua.script(tenant_script, environments.back());
+        }
+        report("environment", tenants, lua.memory_used() - base);
+    }
+}
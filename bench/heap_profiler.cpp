@@ -0,0 +1,61 @@
+#include <sol.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// cost of profiling the heap of an allocation heavy script at different sampling rates
+
+const char* const workload =
+    "local t = {}\n"
+    "for i = 1, 100000 do t[i % 1000 + 1] = { name = 'item' .. i, value = i } end\n"
+    "for i = 1, 50000 do local s = string.rep('x', i % 64) .. i end";
+
+template<typename Fx>
+double measure(Fx&& fx) {
+    const int runs = 5;
+    double best = 0;
+    for(int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fx();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if(i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+int main() {
+    double baseline;
+    {
+        sol::state lua;
+        lua.open_libraries(sol::lib::base, sol::lib::string);
+        baseline = measure([&] {
+            lua.script(workload);
+        });
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(14) << "sample rate" << std::setw(12) << "time (ms)" << std::setw(12) << "overhead" << "samples\n";
+    std::cout << std::left << std::setw(14) << "none" << std::setw(12) << baseline << std::setw(12) << "-" << "-\n";
+
+    std::string report;
+    for(std::size_t rate : { 1, 512, 4096, 64 * 1024, 1024 * 1024 }) {
+        sol::heap_profiler heap(rate);
+        sol::state lua(heap);
+        heap.attach(lua.lua_state());
+        lua.open_libraries(sol::lib::base, sol::lib::string);
+        heap.start();
+        double time = measure([&] {
+            lua.script(workload);
+        });
+        heap.stop();
+        std::cout << std::left << std::setw(14) << rate << std::setw(12) << time
+                  << std::setw(12) << std::to_string((time / baseline - 1) * 100).substr(0, 6) + "%" << heap.samples() << '\n';
+        if(rate == 64 * 1024) {
+            report = heap.dump();
+        }
+    }
+    std::cout << "\nsites at 65536 bytes per sample:\n" << report;
+}
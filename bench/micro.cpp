@@ -0,0 +1,306 @@
+#include <sol.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// overhead of every binding primitive against the same work written by hand with the
+// C API; one CSV line per primitive with the best time per operation of each side
+// usage: micro [iterations]
+
+namespace {
+struct counter {
+    int x = 0;
+
+    int add(int value) {
+        x += value;
+        return x;
+    }
+};
+
+int add(int a, int b) {
+    return a + b;
+}
+
+template<typename Fx>
+double per_op(int iterations, Fx&& fx) {
+    const int runs = 5;
+    double best = 0;
+    for(int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fx();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        if(i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best / iterations;
+}
+
+void report(const char* primitive, int iterations, double sol_ns, double c_ns) {
+    std::cout << primitive << ',' << iterations << ',' << sol_ns << ',' << c_ns << ',' << sol_ns / c_ns << '\n';
+}
+
+// hand-written counterparts
+
+int c_add(lua_State* L) {
+    lua_pushinteger(L, luaL_checkinteger(L, 1) + luaL_checkinteger(L, 2));
+    return 1;
+}
+
+int c_closure_add(lua_State* L) {
+    int offset = static_cast<int>(lua_tointeger(L, lua_upvalueindex(1)));
+    lua_pushinteger(L, luaL_checkinteger(L, 1) + luaL_checkinteger(L, 2) + offset);
+    return 1;
+}
+
+int c_counter_new(lua_State* L) {
+    void* memory = lua_newuserdata(L, sizeof(counter));
+    new (memory) counter();
+    luaL_setmetatable(L, "counter");
+    return 1;
+}
+
+int c_counter_add(lua_State* L) {
+    counter* self = static_cast<counter*>(luaL_checkudata(L, 1, "counter"));
+    lua_pushinteger(L, self->add(static_cast<int>(luaL_checkinteger(L, 2))));
+    return 1;
+}
+
+int c_counter_index(lua_State* L) {
+    counter* self = static_cast<counter*>(luaL_checkudata(L, 1, "counter"));
+    const char* key = luaL_checkstring(L, 2);
+    if(std::strcmp(key, "x") == 0) {
+        lua_pushinteger(L, self->x);
+    }
+    else if(std::strcmp(key, "add") == 0) {
+        lua_pushcfunction(L, &c_counter_add);
+    }
+    else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+int c_counter_newindex(lua_State* L) {
+    counter* self = static_cast<counter*>(luaL_checkudata(L, 1, "counter"));
+    if(std::strcmp(luaL_checkstring(L, 2), "x") != 0) {
+        return luaL_error(L, "no such member");
+    }
+    self->x = static_cast<int>(luaL_checkinteger(L, 3));
+    return 0;
+}
+
+void run_loop(lua_State* L, const char* name, int iterations) {
+    lua_getglobal(L, name);
+    lua_pushinteger(L, iterations);
+    if(lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        std::string err = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw sol::error(err);
+    }
+}
+
+// each loop is defined once per side so both sides run the same bytecode
+void define_loop(sol::state& lua, lua_State* L, const std::string& name, const std::string& body) {
+    std::string source = "function " + name + "(n) for i = 1, n do " + body + " end end";
+    lua.script(source);
+    if(luaL_dostring(L, source.c_str()) != LUA_OK) {
+        std::string err = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw sol::error(err);
+    }
+}
+} // anonymous
+
+int main(int argc, char* argv[]) {
+    const int iterations = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const int container_size = 16;
+    if(iterations <= 0) {
+        std::cerr << "usage: micro [iterations]\n";
+        return 1;
+    }
+
+    try {
+        sol::state lua;
+        lua.open_libraries(sol::lib::base);
+        std::unique_ptr<lua_State, void(*)(lua_State*)> raw(luaL_newstate(), lua_close);
+        lua_State* L = raw.get();
+        luaL_openlibs(L);
+
+        int offset = 1;
+        lua.set_function("add", &add);
+        lua.set_function("lambda_add", [offset](int a, int b) { return a + b + offset; });
+        lua.new_userdata<counter>("counter", "add", &counter::add, "x", &counter::x);
+        lua.script("obj = counter.new()");
+
+        lua_register(L, "add", &c_add);
+        lua_pushinteger(L, offset);
+        lua_pushcclosure(L, &c_closure_add, 1);
+        lua_setglobal(L, "lambda_add");
+        luaL_newmetatable(L, "counter");
+        lua_pushcfunction(L, &c_counter_index);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, &c_counter_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pop(L, 1);
+        lua_register(L, "new_counter", &c_counter_new);
+        luaL_dostring(L, "obj = new_counter()");
+
+        define_loop(lua, L, "free_function", "add(i, 1)");
+        define_loop(lua, L, "lambda", "lambda_add(i, 1)");
+        define_loop(lua, L, "member_function", "obj:add(1)");
+        define_loop(lua, L, "member_get", "local x = obj.x");
+        define_loop(lua, L, "member_set", "obj.x = i");
+
+        std::cout << "primitive,iterations,sol_ns,c_api_ns,ratio\n";
+        const char* const loops[] = { "free_function", "lambda", "member_function", "member_get", "member_set" };
+        for(auto&& name : loops) {
+            sol::function loop = lua.get<sol::function>(name);
+            double sol_ns = per_op(iterations, [&] { loop(iterations); });
+            double c_ns = per_op(iterations, [&] { run_loop(L, name, iterations); });
+            report(name, iterations, sol_ns, c_ns);
+        }
+
+        // tables driven from C++; the hand-written side keeps its table in the registry
+        sol::table table = lua.create_table();
+        lua_newtable(L);
+        int table_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        long long sink = 0;
+
+        report("table_set_string", iterations, per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                table.set("value", i);
+            }
+        }), per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref);
+                lua_pushinteger(L, i);
+                lua_setfield(L, -2, "value");
+                lua_pop(L, 1);
+            }
+        }));
+
+        report("table_get_string", iterations, per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                sink += table.get<int>("value");
+            }
+        }), per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref);
+                lua_getfield(L, -1, "value");
+                sink += static_cast<int>(lua_tointeger(L, -1));
+                lua_pop(L, 2);
+            }
+        }));
+
+        report("table_set_integer", iterations, per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                table.set(i % container_size + 1, i);
+            }
+        }), per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref);
+                lua_pushinteger(L, i);
+                lua_rawseti(L, -2, i % container_size + 1);
+                lua_pop(L, 1);
+            }
+        }));
+
+        report("table_get_integer", iterations, per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                sink += table.get<int>(i % container_size + 1);
+            }
+        }), per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref);
+                lua_rawgeti(L, -1, i % container_size + 1);
+                sink += static_cast<int>(lua_tointeger(L, -1));
+                lua_pop(L, 2);
+            }
+        }));
+        luaL_unref(L, LUA_REGISTRYINDEX, table_ref);
+
+        // containers go through the table pusher; one operation is a whole container
+        std::vector<int> values(container_size);
+        for(int i = 0; i < container_size; ++i) {
+            values[i] = i;
+        }
+        const int containers = iterations / container_size;
+
+        report("container_push", containers, per_op(containers, [&] {
+            for(int i = 0; i < containers; ++i) {
+                lua.set("values", values);
+            }
+        }), per_op(containers, [&] {
+            for(int i = 0; i < containers; ++i) {
+                lua_createtable(L, container_size, 0);
+                for(int j = 0; j < container_size; ++j) {
+                    lua_pushinteger(L, values[j]);
+                    lua_rawseti(L, -2, j + 1);
+                }
+                lua_setglobal(L, "values");
+            }
+        }));
+        lua_createtable(L, container_size, 0);
+        for(int j = 0; j < container_size; ++j) {
+            lua_pushinteger(L, values[j]);
+            lua_rawseti(L, -2, j + 1);
+        }
+        lua_setglobal(L, "values");
+
+        report("container_get", containers, per_op(containers, [&] {
+            for(int i = 0; i < containers; ++i) {
+                sol::table container = lua.get<sol::table>("values");
+                for(int j = 1; j <= container_size; ++j) {
+                    sink += container.get<int>(j);
+                }
+            }
+        }), per_op(containers, [&] {
+            for(int i = 0; i < containers; ++i) {
+                lua_getglobal(L, "values");
+                for(int j = 1; j <= container_size; ++j) {
+                    lua_rawgeti(L, -1, j);
+                    sink += static_cast<int>(lua_tointeger(L, -1));
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+        }));
+
+        // calls from C++ into Lua
+        const char* const square = "function square(x) return x * x end";
+        lua.script(square);
+        luaL_dostring(L, square);
+        sol::function fx = lua.get<sol::function>("square");
+        lua_getglobal(L, "square");
+        int fx_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        report("function_call", iterations, per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                sink += fx.call<int>(i % 1000);
+            }
+        }), per_op(iterations, [&] {
+            for(int i = 0; i < iterations; ++i) {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, fx_ref);
+                lua_pushinteger(L, i % 1000);
+                if(lua_pcall(L, 1, 1, 0) != LUA_OK) {
+                    throw sol::error(lua_tostring(L, -1));
+                }
+                sink += static_cast<int>(lua_tointeger(L, -1));
+                lua_pop(L, 1);
+            }
+        }));
+        luaL_unref(L, LUA_REGISTRYINDEX, fx_ref);
+
+        // keeps the reads from being optimised away
+        std::cerr << "checksum " << sink << '\n';
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,223 @@
+#include <sol.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// workloads shaped like real embeddings rather than single primitives, so that garbage
+// collection and cache misses across many bound objects show up in the numbers:
+//   entities   a game update loop over thousands of userdata, one operation per frame
+//   config     loading a large generated config.lua into structs, one operation per load
+//   events     dispatching batches of events to handlers written in Lua, one operation per batch
+// one CSV line per scenario; memory is the peak and the final size of the Lua heap
+
+namespace {
+// counts the bytes Lua holds on top of the default allocation
+struct tracking_allocator {
+    std::size_t current = 0;
+    std::size_t peak = 0;
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        if(ptr == nullptr) {
+            osize = 0;
+        }
+        void* result = sol::detail::default_allocate(nullptr, ptr, osize, nsize);
+        if(nsize == 0 || result != nullptr) {
+            current = current - osize + nsize;
+            peak = std::max(peak, current);
+        }
+        return result;
+    }
+};
+
+struct entity {
+    double x = 0, y = 0;
+    double vx = 0, vy = 0;
+
+    void update(double dt) {
+        x += vx * dt;
+        y += vy * dt;
+    }
+};
+
+struct window {
+    std::string name;
+    int width = 0;
+    int height = 0;
+    bool resizable = false;
+    std::vector<std::string> tags;
+};
+
+struct result {
+    std::vector<double> latencies; // microseconds
+    double seconds = 0;
+    std::size_t peak = 0;
+    std::size_t live = 0;
+};
+
+template<typename Fx>
+void measure(result& r, int operations, Fx&& fx) {
+    r.latencies.reserve(operations);
+    auto begin = std::chrono::steady_clock::now();
+    for(int i = 0; i < operations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fx(i);
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        r.latencies.push_back(elapsed.count());
+    }
+    std::chrono::duration<double> total = std::chrono::steady_clock::now() - begin;
+    r.seconds = total.count();
+}
+
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    std::size_t index = static_cast<std::size_t>(p * values.size());
+    return values[std::min(index, values.size() - 1)];
+}
+
+void report(const char* scenario, const result& r) {
+    std::size_t operations = r.latencies.size();
+    std::cout << scenario << ',' << operations << ',' << operations / r.seconds << ','
+              << percentile(r.latencies, 0.50) << ',' << percentile(r.latencies, 0.99) << ','
+              << r.peak / 1024 << ',' << r.live / 1024 << '\n';
+}
+
+result entities(int count, int frames) {
+    result r;
+    tracking_allocator memory;
+    sol::state lua(memory);
+    lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::table);
+    lua.new_userdata<entity>("entity", "update", &entity::update,
+                             "x", &entity::x, "y", &entity::y,
+                             "vx", &entity::vx, "vy", &entity::vy);
+    lua.script("entities = {}\n"
+               "function spawn(n)\n"
+               "    for i = 1, n do\n"
+               "        local e = entity.new()\n"
+               "        e.vx = (i % 7) - 3\n"
+               "        e.vy = (i % 5) - 2\n"
+               "        entities[i] = e\n"
+               "    end\n"
+               "end\n"
+               "function frame(dt)\n"
+               "    local hits = {}\n"
+               "    for i, e in ipairs(entities) do\n"
+               "        e:update(dt)\n"
+               "        if math.abs(e.x) > 100 then\n"
+               "            e.x = 0\n"
+               "            hits[#hits + 1] = { id = i, y = e.y }\n"
+               "        end\n"
+               "    end\n"
+               "    return #hits\n"
+               "end");
+    lua.get<sol::function>("spawn").call(count);
+    sol::function frame = lua.get<sol::function>("frame");
+    measure(r, frames, [&](int) {
+        frame.call<int>(1.0 / 60);
+    });
+    r.peak = memory.peak;
+    r.live = memory.current;
+    return r;
+}
+
+std::string generate_config(int windows) {
+    std::ostringstream out;
+    out << "title = \"scenario\"\nversion = 3\nwindows = {\n";
+    for(int i = 0; i < windows; ++i) {
+        out << "    { name = \"window" << i << "\", width = " << 640 + i % 640
+            << ", height = " << 480 + i % 480 << ", resizable = " << (i % 2 ? "true" : "false")
+            << ", tags = { \"tag" << i % 13 << "\", \"group" << i % 29 << "\" } },\n";
+    }
+    out << "}\n";
+    return out.str();
+}
+
+result config(int windows, int loads) {
+    result r;
+    std::string source = generate_config(windows);
+    std::vector<window> loaded;
+    measure(r, loads, [&](int) {
+        tracking_allocator memory;
+        sol::state lua(memory);
+        lua.script(source);
+        sol::table list = lua.get<sol::table>("windows");
+        std::size_t size = list.size();
+        loaded.clear();
+        loaded.reserve(size);
+        for(std::size_t i = 1; i <= size; ++i) {
+            sol::table entry = list.get<sol::table>(i);
+            window w;
+            w.name = entry.get<std::string>("name");
+            w.width = entry.get<int>("width");
+            w.height = entry.get<int>("height");
+            w.resizable = entry.get<bool>("resizable");
+            sol::table tags = entry.get<sol::table>("tags");
+            for(std::size_t t = 1, n = tags.size(); t <= n; ++t) {
+                w.tags.push_back(tags.get<std::string>(t));
+            }
+            loaded.push_back(std::move(w));
+        }
+        r.peak = std::max(r.peak, memory.peak);
+        r.live = memory.current;
+    });
+    if(loaded.size() != static_cast<std::size_t>(windows)) {
+        throw sol::error("config scenario loaded the wrong number of windows");
+    }
+    return r;
+}
+
+result events(int batches, int batch_size) {
+    result r;
+    tracking_allocator memory;
+    sol::state lua(memory);
+    lua.open_libraries(sol::lib::base, sol::lib::string);
+    lua.script("handlers = {}\n"
+               "stats = { damage = 0, messages = 0, moves = 0 }\n"
+               "function on(name, fx)\n"
+               "    local list = handlers[name]\n"
+               "    if not list then list = {} handlers[name] = list end\n"
+               "    list[#list + 1] = fx\n"
+               "end\n"
+               "on('damage', function(id, amount) stats.damage = stats.damage + amount end)\n"
+               "on('damage', function(id, amount) if amount > 90 then stats.last = 'crit' .. id end end)\n"
+               "on('message', function(id, amount) stats.messages = stats.messages + 1 end)\n"
+               "on('message', function(id, amount) local text = string.format('%d:%d', id, amount) end)\n"
+               "on('move', function(id, amount) stats.moves = stats.moves + 1 end)\n");
+    const char* const names[] = { "damage", "message", "move" };
+    sol::table handlers = lua.get<sol::table>("handlers");
+    measure(r, batches, [&](int batch) {
+        for(int i = 0; i < batch_size; ++i) {
+            sol::table list = handlers.get<sol::table>(names[i % 3]);
+            for(std::size_t h = 1, n = list.size(); h <= n; ++h) {
+                list.get<sol::function>(h).call(batch * batch_size + i, i % 100);
+            }
+        }
+    });
+    r.peak = memory.peak;
+    r.live = memory.current;
+    return r;
+}
+} // anonymous
+
+int main(int argc, char* argv[]) {
+    // scales every scenario, 1 being the default size
+    const int scale = argc > 1 ? std::atoi(argv[1]) : 1;
+    if(scale <= 0) {
+        std::cerr << "usage: scenarios [scale]\n";
+        return 1;
+    }
+
+    try {
+        std::cout << "scenario,operations,ops_per_second,p50_us,p99_us,peak_kb,live_kb\n";
+        report("entities", entities(5000 * scale, 300));
+        report("config", config(2000 * scale, 30));
+        report("events", events(300, 1000 * scale));
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,94 @@
+#include <sol.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// round trip of a large script generated table: Lua source text versus a binary snapshot
+
+const char* const generate =
+    "data = {}\n"
+    "for i = 1, 50000 do\n"
+    "    data[i] = { id = i, name = 'entity' .. i, score = i * 0.5, alive = i % 3 ~= 0,\n"
+    "                tags = { 'a', 'b', 'c' } }\n"
+    "end";
+
+// the usual approach: print the table as a chunk that rebuilds it
+const char* const serializer =
+    "function serialize(value, out)\n"
+    "    local t = type(value)\n"
+    "    if t == 'table' then\n"
+    "        out[#out + 1] = '{'\n"
+    "        for k, v in pairs(value) do\n"
+    "            out[#out + 1] = '['\n"
+    "            serialize(k, out)\n"
+    "            out[#out + 1] = ']='\n"
+    "            serialize(v, out)\n"
+    "            out[#out + 1] = ','\n"
+    "        end\n"
+    "        out[#out + 1] = '}'\n"
+    "    elseif t == 'string' then\n"
+    "        out[#out + 1] = string.format('%q', value)\n"
+    "    else\n"
+    "        out[#out + 1] = t == 'number' and string.format('%.17g', value) or tostring(value)\n"
+    "    end\n"
+    "end\n"
+    "function save(filename)\n"
+    "    local out = { 'return ' }\n"
+    "    serialize(data, out)\n"
+    "    local file = assert(io.open(filename, 'wb'))\n"
+    "    file:write(table.concat(out))\n"
+    "    file:close()\n"
+    "end";
+
+std::size_t file_size(const char* filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    return static_cast<std::size_t>(file.tellg());
+}
+
+template<typename Fx>
+double measure(Fx&& fx) {
+    auto start = std::chrono::steady_clock::now();
+    fx();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void report(const char* name, double save, double load, std::size_t size) {
+    std::cout << std::left << std::setw(12) << name << std::setw(12) << save
+              << std::setw(12) << load << size << '\n';
+}
+
+int main() {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::string, sol::lib::table, sol::lib::io);
+    lua.script(generate);
+    lua.script(serializer);
+
+    std::cout << std::left << std::setw(12) << "format" << std::setw(12) << "save (ms)"
+              << std::setw(12) << "load (ms)" << "bytes\n";
+
+    const char* source_file = "bench_snapshot.lua";
+    double save = measure([&] {
+        lua.get<sol::function>("save").call(source_file);
+    });
+    double load = measure([&] {
+        sol::state other;
+        other.open_file(source_file);
+    });
+    report("source", save, load, file_size(source_file));
+    std::remove(source_file);
+
+    const char* snapshot_file = "bench_snapshot.solsnap";
+    save = measure([&] {
+        sol::write_snapshot(lua.get<sol::table>("data"), snapshot_file);
+    });
+    load = measure([&] {
+        sol::state other;
+        sol::read_snapshot(other.lua_state(), snapshot_file);
+    });
+    report("snapshot", save, load, file_size(snapshot_file));
+    std::remove(snapshot_file);
+}
@@ -0,0 +1,71 @@
+#include <sol.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// request throughput of a shared state_pool as worker threads are added
+// every request checks a state out, runs a lua handler and checks it back in
+
+struct request {
+    int id = 0;
+    int weight = 1;
+};
+
+void setup(sol::state& lua) {
+    lua.open_libraries(sol::lib::base, sol::lib::string, sol::lib::table);
+    lua.new_userdata<request>("request", "id", &request::id, "weight", &request::weight);
+    lua.script("function handle(id)\n"
+               "    local parts = {}\n"
+               "    for i = 1, 64 do parts[i] = id * i end\n"
+               "    scratch = table.concat(parts, ',')\n"
+               "    return #scratch\n"
+               "end");
+}
+
+double run(sol::state_pool& pool, unsigned threads, int requests) {
+    std::atomic<long long> checksum(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&pool, &checksum, requests] {
+            long long local = 0;
+            for(int i = 0; i < requests; ++i) {
+                sol::state_pool::handle lua = pool.checkout();
+                local += lua->get<sol::function>("handle").call<int>(i);
+            }
+            checksum += local;
+        });
+    }
+    for(auto&& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return threads * requests / elapsed.count();
+}
+
+int main() {
+    const int requests = 20000;
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    sol::state_pool pool(setup, cores, cores);
+
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(18) << "requests/s" << "scaling\n";
+    // powers of two below the core count, then every core
+    std::vector<unsigned> counts;
+    for(unsigned threads = 1; threads < cores; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(cores);
+
+    double single = 0;
+    for(unsigned threads : counts) {
+        double throughput = run(pool, threads, requests);
+        if(threads == 1) {
+            single = throughput;
+        }
+        std::cout << std::setw(10) << threads << std::setw(18) << throughput << throughput / single << '\n';
+    }
+}
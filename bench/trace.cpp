@@ -0,0 +1,68 @@
+#define SOL_TRACE
+#include <sol.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// cost of tracing the crossings between C++ and Lua on a workload made of little else
+// than calls to a bound function; pass a filename to also write the trace, which
+// tools/trace_decode prints
+
+int add(int a, int b) {
+    return a + b;
+}
+
+const char* const workload = "local total = 0 for i = 1, 200000 do total = add(total, i) end";
+
+template<typename Fx>
+double measure(Fx&& fx) {
+    const int runs = 5;
+    double best = 0;
+    for(int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fx();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if(i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.set_function("add", &add);
+    lua.script("function square(x) return x * x end");
+    sol::function square = lua.get<sol::function>("square");
+
+    double traced = measure([&] {
+        lua.script(workload);
+    });
+    double calls = measure([&] {
+        for(int i = 0; i < 20000; ++i) {
+            square.call<int>(i);
+        }
+    });
+    double records = measure([&] {
+        for(int i = 0; i < 200000; ++i) {
+            sol::trace_scope scope(sol::trace_kind::binding_call, 0, 2);
+        }
+    });
+    lua.gc().collect();
+
+    // every bound call writes a begin and an end record
+    double per_record = records * 1e6 / 400000;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "script making 200000 bound calls: " << traced << " ms\n";
+    std::cout << "20000 calls into Lua:             " << calls << " ms\n";
+    std::cout << "cost of one record:               " << per_record << " ns\n";
+    std::cout << "share of the script spent tracing: " << records / traced * 100 << "%\n";
+
+    std::vector<sol::trace_record> kept = sol::trace_records();
+    std::cout << kept.size() << " records kept, " << SOL_TRACE_CAPACITY << " per thread\n";
+    if(argc > 1) {
+        sol::dump_trace(argv[1]);
+        std::cout << "trace written to " << argv[1] << '\n';
+    }
+}
@@ -4,6 +4,8 @@ import ninja_syntax
 import os, sys, glob
 import itertools
 import argparse
+import subprocess
+import time
 
 # utilities
 def flags(*args):
@@ -29,6 +31,64 @@ def replace_extension(f, e):
     (root, ext) = os.path.splitext(f)
     return root + e
 
+# a translation unit binding count free functions, count stateful lambdas and count / 10
+# userdata types, the way large binding files do
+def stress_source(count):
+    lines = ['#include <sol.hpp>', '#include <string>', '']
+    types = max(1, count // 10)
+    signatures = [('int a', 'a'),
+                  ('int a, double b', 'a + static_cast<int>(b)'),
+                  ('int a, double b, const std::string& c', 'a + static_cast<int>(b) + static_cast<int>(c.size())'),
+                  ('const std::string& c, bool d, int a, float e', 'static_cast<int>(c.size()) + d + a + static_cast<int>(e)')]
+    for i in range(count):
+        (parameters, body) = signatures[i % len(signatures)]
+        lines.append('int free_{0}({1}) {{ return {2} + {0}; }}'.format(i, parameters, body))
+    for t in range(types):
+        lines.extend([
+            'struct type_{0} {{'.format(t),
+            '    int x = {0};'.format(t),
+            '    double y = 0;',
+            '    std::string name;',
+            '    int get() const { return x; }',
+            '    void set(int value) { x = value; }',
+            '    double scale(double factor, int times) { return y * factor * times; }',
+            '};'
+        ])
+    lines.extend(['', 'int main() {', '    sol::state lua;', '    int offset = 1;'])
+    for i in range(count):
+        lines.append('    lua.set_function("free_{0}", &free_{0});'.format(i))
+        lines.append('    lua.set_function("lambda_{0}", [offset](int a, double b) {{ return a * b + offset + {0}; }});'.format(i))
+    for t in range(types):
+        lines.append('    lua.new_userdata<type_{0}>("type_{0}", "get", &type_{0}::get, "set", &type_{0}::set, "scale", &type_{0}::scale,'.format(t))
+        lines.append('                           "x", &type_{0}::x, "y", &type_{0}::y, "name", &type_{0}::name);'.format(t))
+    lines.extend(['}', ''])
+    return '\n'.join(lines)
+
+# compiles the stress translation unit and prints the compile time, peak compiler memory and
+# object size as CSV; peak memory needs the resource module, so it is only reported on unix
+def run_stress(count, cxx, cxxflags):
+    directory = os.path.join(objdir, 'stress')
+    if not os.path.isdir(directory):
+        os.makedirs(directory)
+    source = os.path.join(directory, 'stress.cpp')
+    obj = replace_extension(source, '.o')
+    with open(source, 'w') as f:
+        f.write(stress_source(count))
+    command = '{} -c {} {} -o {}'.format(cxx, cxxflags, source, obj)
+    start = time.time()
+    status = subprocess.call(command, shell = True)
+    elapsed = time.time() - start
+    if status != 0:
+        sys.exit(status)
+    peak = ''
+    try:
+        import resource
+        peak = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+    except ImportError:
+        pass
+    print('count,compile_seconds,peak_kb,object_bytes')
+    print('{},{:.2f},{},{}'.format(count, elapsed, peak, os.path.getsize(obj)))
+
 # Default install dir
 install_dir = os.path.join('/usr', 'include') if 'linux' in sys.platform else 'include'
 
@@ -39,6 +99,7 @@ parser.add_argument('--cxx', metavar='<compiler>', help='compiler name to use (d
 parser.add_argument('--ci', action='store_true', help=argparse.SUPPRESS)
 parser.add_argument('--testing', action='store_true', help=argparse.SUPPRESS)
 parser.add_argument('--lua-dir', metavar='<dir>', help='directory lua is in with include and lib subdirectories')
+parser.add_argument('--stress', metavar='<count>', type=int, nargs='?', const=200, help='compile a generated binding stress test of <count> functions (default: 200) and report its cost instead')
 parser.add_argument('--install-dir', metavar='<dir>', help='directory to install the headers to', default=install_dir);
 parser.epilog = """In order to install sol, administrative privileges might be required.
 Note that installation is done through the 'ninja install' command. To uninstall, the
@@ -85,11 +146,18 @@ if args.testing:
     cxxflags.append('-Wmissing-declarations')
 
 if 'linux' in sys.platform:
-    ldflags.extend(libraries(['dl']))
+    ldflags.extend(libraries(['dl', 'pthread']))
 
 builddir = 'bin'
 objdir = 'obj'
 tests = os.path.join(builddir, 'tests')
+# built apart from the other tests because SOL_CALL_METRICS changes every binding
+metrics_tests = os.path.join(builddir, 'metrics_tests')
+bench_suites = [os.path.join(builddir, 'bench', x) for x in ['micro', 'scenarios', 'allocations']]
+
+if args.stress:
+    run_stress(args.stress, args.cxx, flags(cxxflags + includes(include) + dependencies(depends)))
+    sys.exit(0)
 
 # ninja file
 ninja = ninja_syntax.Writer(open('build.ninja', 'w'))
@@ -108,7 +176,8 @@ ninja.rule('compile', command = '$cxx -MMD -MF $out.d -c $cxxflags -Werror $in -
                       deps = 'gcc', depfile = '$out.d',
                       description = 'Compiling $in to $out')
 ninja.rule('link', command = '$cxx $cxxflags $in -o $out $ldflags', description = 'Creating $out')
-ninja.rule('runner', command = tests)
+ninja.rule('runner', command = tests + ' && ' + metrics_tests)
+ninja.rule('bench_runner', command = '$in', description = 'Running $in', pool = 'console')
 ninja.rule('example', command = '$cxx $cxxflags $in -o $out $ldflags')
 ninja.rule('installer', command = copy_command)
 ninja.rule('uninstaller', command = remove_command)
@@ -129,10 +198,35 @@ for f in glob.glob('examples/*.cpp'):
     examples.append(example)
     ninja.build(example, 'example', inputs = f)
 
+tools = []
+for f in glob.glob('tools/*.cpp'):
+    tool = os.path.join(builddir, replace_extension(f, ''))
+    tools.append(tool)
+    ninja.build(tool, 'example', inputs = f)
+
+benchmarks = []
+for f in glob.glob('bench/*.cpp'):
+    benchmark = os.path.join(builddir, replace_extension(f, ''))
+    benchmarks.append(benchmark)
+    ninja.build(benchmark, 'example', inputs = f)
+
+metrics_object_file = object_file('metrics_tests.cpp')
+ninja.build(metrics_object_file, 'compile', inputs = 'metrics_tests.cpp')
+
 ninja.build(tests, 'link', inputs = tests_object_files)
-ninja.build('tests', 'phony', inputs = tests)
+ninja.build(metrics_tests, 'link', inputs = metrics_object_file)
+ninja.build('tests', 'phony', inputs = [tests, metrics_tests])
 ninja.build('install', 'installer', inputs = args.install_dir)
 ninja.build('uninstall', 'uninstaller')
 ninja.build('examples', 'phony', inputs = examples)
+ninja.build('tools', 'phony', inputs = tools)
+ninja.build('benchmarks', 'phony', inputs = benchmarks)
 ninja.build('run', 'runner', implicit = 'tests')
+# bench is also a directory, so the benchmarks run behind an alias that is never up to date
+bench_runs = []
+for suite in bench_suites:
+    run = 'run_' + os.path.basename(suite)
+    bench_runs.append(run)
+    ninja.build(run, 'bench_runner', inputs = suite)
+ninja.build('bench', 'phony', inputs = bench_runs)
 ninja.default('run')
@@ -0,0 +1,70 @@
+#define CATCH_CONFIG_MAIN
+#define SOL_CALL_METRICS
+#include <catch.hpp>
+#include <sol.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// built as its own program: SOL_CALL_METRICS changes every binding, so it cannot share
+// a binary with tests built without it
+
+namespace {
+struct accumulator {
+    int total = 0;
+
+    int add(int x) {
+        total += x;
+        return total;
+    }
+};
+
+int square(int x) {
+    if(x < 0) {
+        throw std::runtime_error("negative");
+    }
+    return x * x;
+}
+
+sol::call_report report_for(const std::string& name) {
+    std::vector<sol::call_report> report = sol::call_metrics::report();
+    auto it = std::find_if(report.begin(), report.end(), [&] (const sol::call_report& r) {
+        return r.name == name;
+    });
+    return it == report.end() ? sol::call_report() : *it;
+}
+} // anonymous
+
+TEST_CASE("metrics/set_function", "functions bound through set_function are metered under their name") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    accumulator acc;
+    lua.set_function("square", &square);
+    lua.set_function("offset", [] (int x) { return x + 1; });
+    lua.set_function("accumulate", &accumulator::add, acc);
+    sol::table nested = lua.create_table();
+    nested.set_function("square", &square);
+    lua.set("nested", nested);
+
+    sol::call_metrics::reset();
+    lua.script("for i = 1, 100 do assert(square(i) == i * i) end\n"
+               "for i = 1, 20 do offset(i) end\n"
+               "for i = 1, 5 do accumulate(i) end\n"
+               "nested.square(3)");
+    REQUIRE_THROWS(lua.script("square(-1)"));
+
+    sol::call_report free_function = report_for("square");
+    REQUIRE(free_function.calls == 102);
+    REQUIRE(free_function.errors == 1);
+    REQUIRE(free_function.total.count() > 0);
+    REQUIRE(report_for("offset").calls == 20);
+    REQUIRE(report_for("accumulate").calls == 5);
+    REQUIRE(acc.total == 15);
+
+    // tables share the registry by name, so a name bound twice sums up
+    sol::call_metrics::reset();
+    lua.script("nested.square(2)");
+    REQUIRE(report_for("square").calls == 1);
+    REQUIRE(report_for("offset").calls == 0);
+}
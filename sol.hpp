@@ -25,5 +25,16 @@
 #include "sol/state.hpp"
 #include "sol/object.hpp"
 #include "sol/function.hpp"
+#include "sol/state_pool.hpp"
+#include "sol/transfer.hpp"
+#include "sol/snapshot.hpp"
+#include "sol/msgpack.hpp"
+#include "sol/json.hpp"
+#include "sol/budget.hpp"
+#include "sol/profiler.hpp"
+#include "sol/heap_profiler.hpp"
+#include "sol/instances.hpp"
+#include "sol/trace.hpp"
+#include "sol/allocation_counter.hpp"
 
 #endif // SOL_HPP
@@ -0,0 +1,204 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_ALLOCATION_COUNTER_HPP
+#define SOL_ALLOCATION_COUNTER_HPP
+
+#include "allocator.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+// the counting allocation functions stay out of line so that the compiler never sees
+// operator new returning malloc'd memory that operator delete hands to free
+#ifndef SOL_NOINLINE
+    #ifdef _MSC_VER
+        #define SOL_NOINLINE __declspec(noinline)
+    #elif __GNUC__
+        #define SOL_NOINLINE __attribute__((noinline))
+    #else
+        #define SOL_NOINLINE
+    #endif // compilers
+#endif // SOL_NOINLINE
+
+namespace sol {
+struct allocation_count {
+    std::size_t lua_allocations;
+    std::size_t lua_bytes;
+    std::size_t cpp_allocations;
+    std::size_t cpp_bytes;
+
+    std::size_t allocations() const noexcept {
+        return lua_allocations + cpp_allocations;
+    }
+};
+
+namespace detail {
+struct cpp_allocation_tally {
+    bool counting;
+    std::size_t allocations;
+    std::size_t bytes;
+};
+
+// per thread so that other threads allocating during a measurement are not counted
+inline cpp_allocation_tally& cpp_allocations() noexcept {
+    static thread_local cpp_allocation_tally tally = { false, 0, 0 };
+    return tally;
+}
+
+SOL_NOINLINE inline void* counted_new(std::size_t size) {
+    cpp_allocation_tally& tally = cpp_allocations();
+    if(tally.counting) {
+        ++tally.allocations;
+        tally.bytes += size;
+    }
+    if(size == 0) {
+        size = 1;
+    }
+    for(;;) {
+        if(void* block = std::malloc(size)) {
+            return block;
+        }
+        std::new_handler handler = std::set_new_handler(nullptr);
+        std::set_new_handler(handler);
+        if(handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+inline void* counted_new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return counted_new(size);
+    }
+    catch(...) {
+        return nullptr;
+    }
+}
+
+SOL_NOINLINE inline void counted_delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+} // detail
+
+// Counts the allocations made while a piece of code runs, both by the Lua state using this
+// allocator and, when SOL_COUNT_NEW_ALLOCATIONS appears in one translation unit of the
+// program, by global operator new on the calling thread. Meant for tests and benchmarks
+// that check a path does not allocate once warmed up; not thread safe.
+class allocation_counter {
+private:
+    lua_Alloc upstream;
+    void* upstream_data;
+    bool counting = false;
+    allocation_count count = { 0, 0, 0, 0 };
+
+public:
+    allocation_counter(): allocation_counter(&detail::default_allocate, nullptr) {}
+
+    allocation_counter(lua_Alloc allocator, void* userdata): upstream(allocator), upstream_data(userdata) {}
+
+    template<typename Allocator, DisableIf<std::is_same<Allocator, allocation_counter>> = 0>
+    explicit allocation_counter(Allocator& allocator):
+    allocation_counter(&detail::allocate<Allocator>, std::addressof(allocator)) {}
+
+    allocation_counter(const allocation_counter&) = delete;
+    allocation_counter& operator=(const allocation_counter&) = delete;
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        void* result = upstream(upstream_data, ptr, osize, nsize);
+        if(counting && result != nullptr) {
+            // osize is the type of the object for new blocks, and growing a block may move it
+            if(ptr == nullptr) {
+                ++count.lua_allocations;
+                count.lua_bytes += nsize;
+            }
+            else if(nsize > osize) {
+                ++count.lua_allocations;
+                count.lua_bytes += nsize - osize;
+            }
+        }
+        return result;
+    }
+
+    void start() noexcept {
+        count = allocation_count{ 0, 0, 0, 0 };
+        detail::cpp_allocation_tally& tally = detail::cpp_allocations();
+        tally.allocations = 0;
+        tally.bytes = 0;
+        tally.counting = true;
+        counting = true;
+    }
+
+    allocation_count stop() noexcept {
+        detail::cpp_allocation_tally& tally = detail::cpp_allocations();
+        tally.counting = false;
+        counting = false;
+        count.cpp_allocations = tally.allocations;
+        count.cpp_bytes = tally.bytes;
+        return count;
+    }
+
+    template<typename Fx>
+    allocation_count measure(Fx&& fx) {
+        start();
+        try {
+            fx();
+        }
+        catch(...) {
+            stop();
+            throw;
+        }
+        return stop();
+    }
+};
+} // sol
+
+// replaces the global allocation functions with ones that count for allocation_counter;
+// expand it once, at namespace scope, in the program being measured
+#define SOL_COUNT_NEW_ALLOCATIONS \
+    void* operator new(std::size_t size) { \
+        return ::sol::detail::counted_new(size); \
+    } \
+    void* operator new[](std::size_t size) { \
+        return ::sol::detail::counted_new(size); \
+    } \
+    void* operator new(std::size_t size, const std::nothrow_t& tag) noexcept { \
+        return ::sol::detail::counted_new(size, tag); \
+    } \
+    void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { \
+        return ::sol::detail::counted_new(size, tag); \
+    } \
+    void operator delete(void* ptr) noexcept { \
+        ::sol::detail::counted_delete(ptr); \
+    } \
+    void operator delete[](void* ptr) noexcept { \
+        ::sol::detail::counted_delete(ptr); \
+    } \
+    void operator delete(void* ptr, const std::nothrow_t&) noexcept { \
+        ::sol::detail::counted_delete(ptr); \
+    } \
+    void operator delete[](void* ptr, const std::nothrow_t&) noexcept { \
+        ::sol::detail::counted_delete(ptr); \
+    }
+
+#endif // SOL_ALLOCATION_COUNTER_HPP
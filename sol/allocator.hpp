@@ -0,0 +1,432 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_ALLOCATOR_HPP
+#define SOL_ALLOCATOR_HPP
+
+#include "types.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace sol {
+namespace detail {
+// adapts an object with the lua_Alloc signature, minus the user data pointer, into a lua_Alloc
+// note that when ptr is null, osize is the type of the object being allocated rather than a size
+template<typename Allocator>
+inline void* allocate(void* ud, void* ptr, std::size_t osize, std::size_t nsize) {
+    Allocator& alloc = *static_cast<Allocator*>(ud);
+    return alloc(ptr, osize, nsize);
+}
+
+// the same behaviour as the allocator installed by luaL_newstate
+inline void* default_allocate(void*, void* ptr, std::size_t, std::size_t nsize) {
+    if(nsize == 0) {
+        std::free(ptr);
+        return nullptr;
+    }
+    return std::realloc(ptr, nsize);
+}
+} // detail
+
+// Size class pool tuned for the many small blocks Lua allocates (strings, tables, closures).
+// Blocks up to max_pooled bytes come from per-class free lists carved out of large slabs,
+// anything bigger goes straight to malloc. A pool is not thread safe: give each state its own,
+// which also keeps states running on different threads from contending on the global heap.
+class pool_allocator {
+public:
+    static const std::size_t granularity = 16;
+    static const std::size_t max_pooled = 256;
+    static const std::size_t slab_size = 64 * 1024;
+private:
+    static const std::size_t class_count = max_pooled / granularity;
+
+    struct free_block {
+        free_block* next;
+    };
+
+    std::array<free_block*, class_count> free_lists;
+    std::vector<void*> slabs;
+    char* cursor = nullptr;
+    std::size_t remaining = 0;
+
+    static std::size_t size_class(std::size_t size) noexcept {
+        return (size - 1) / granularity;
+    }
+
+    void* allocate_small(std::size_t size) {
+        std::size_t index = size_class(size);
+        free_block* block = free_lists[index];
+        if(block != nullptr) {
+            free_lists[index] = block->next;
+            return block;
+        }
+
+        std::size_t rounded = (index + 1) * granularity;
+        if(remaining < rounded) {
+            // hand the tail of the current slab out to the classes that still fit
+            while(remaining != 0) {
+                std::size_t piece = remaining;
+                if(piece > max_pooled) {
+                    piece = max_pooled;
+                }
+                deallocate_small(cursor, piece);
+                cursor += piece;
+                remaining -= piece;
+            }
+            void* slab = std::malloc(slab_size);
+            if(slab == nullptr) {
+                return nullptr;
+            }
+            slabs.push_back(slab);
+            cursor = static_cast<char*>(slab);
+            remaining = slab_size;
+        }
+        void* result = cursor;
+        cursor += rounded;
+        remaining -= rounded;
+        return result;
+    }
+
+    void deallocate_small(void* ptr, std::size_t size) noexcept {
+        std::size_t index = size_class(size);
+        free_block* block = static_cast<free_block*>(ptr);
+        block->next = free_lists[index];
+        free_lists[index] = block;
+    }
+
+    void* allocate(std::size_t size) {
+        return size <= max_pooled ? allocate_small(size) : std::malloc(size);
+    }
+
+    void deallocate(void* ptr, std::size_t size) noexcept {
+        if(size <= max_pooled) {
+            deallocate_small(ptr, size);
+        }
+        else {
+            std::free(ptr);
+        }
+    }
+public:
+    pool_allocator() {
+        free_lists.fill(nullptr);
+    }
+
+    pool_allocator(const pool_allocator&) = delete;
+    pool_allocator& operator=(const pool_allocator&) = delete;
+
+    ~pool_allocator() {
+        for(void* slab : slabs) {
+            std::free(slab);
+        }
+    }
+
+    std::size_t slab_count() const noexcept {
+        return slabs.size();
+    }
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        if(ptr == nullptr) {
+            return nsize == 0 ? nullptr : allocate(nsize);
+        }
+
+        if(nsize == 0) {
+            deallocate(ptr, osize);
+            return nullptr;
+        }
+
+        if(osize > max_pooled && nsize > max_pooled) {
+            void* result = std::realloc(ptr, nsize);
+            // lua assumes shrinking never fails
+            return result == nullptr && nsize <= osize ? ptr : result;
+        }
+
+        if(osize <= max_pooled && nsize <= max_pooled && size_class(osize) == size_class(nsize)) {
+            return ptr;
+        }
+
+        void* result = allocate(nsize);
+        if(result == nullptr) {
+            return nsize <= osize ? ptr : nullptr;
+        }
+        std::memcpy(result, ptr, osize < nsize ? osize : nsize);
+        deallocate(ptr, osize);
+        return result;
+    }
+};
+// Bump allocator for short lived states. Freed blocks are only reclaimed when they are the
+// most recent allocation, so lua_close no longer pays for one free per object and the whole
+// arena is returned at once by reset or release. Finalizers still run when the state closes.
+// A capacity of 0 means the arena may grow without bound.
+class arena_allocator {
+public:
+    static const std::size_t alignment = 16;
+private:
+    struct chunk {
+        chunk* next;
+        std::size_t size;
+    };
+
+    chunk* head = nullptr;
+    char* cursor = nullptr;
+    char* end = nullptr;
+    std::size_t chunk_size;
+    std::size_t capacity;
+    std::size_t reserved_bytes = 0;
+    std::size_t used_bytes = 0;
+
+    static std::size_t round(std::size_t size) noexcept {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    static std::size_t header_size() noexcept {
+        return round(sizeof(chunk));
+    }
+
+    bool is_last(void* ptr, std::size_t size) const noexcept {
+        return static_cast<char*>(ptr) + round(size) == cursor;
+    }
+
+    bool grow(std::size_t size) {
+        std::size_t bytes = header_size() + (size > chunk_size ? size : chunk_size);
+        if(capacity != 0 && reserved_bytes + bytes > capacity) {
+            return false;
+        }
+        chunk* c = static_cast<chunk*>(std::malloc(bytes));
+        if(c == nullptr) {
+            return false;
+        }
+        c->next = head;
+        c->size = bytes;
+        head = c;
+        cursor = reinterpret_cast<char*>(c) + header_size();
+        end = reinterpret_cast<char*>(c) + bytes;
+        reserved_bytes += bytes;
+        return true;
+    }
+
+    void* bump(std::size_t size) {
+        std::size_t rounded = round(size);
+        if(static_cast<std::size_t>(end - cursor) < rounded && !grow(rounded)) {
+            return nullptr;
+        }
+        void* result = cursor;
+        cursor += rounded;
+        used_bytes += rounded;
+        return result;
+    }
+
+    void free_chunks(chunk* c) noexcept {
+        while(c != nullptr) {
+            chunk* next = c->next;
+            reserved_bytes -= c->size;
+            std::free(c);
+            c = next;
+        }
+    }
+public:
+    explicit arena_allocator(std::size_t chunk_size = 256 * 1024, std::size_t capacity = 0):
+    chunk_size(round(chunk_size)), capacity(capacity) {}
+
+    arena_allocator(const arena_allocator&) = delete;
+    arena_allocator& operator=(const arena_allocator&) = delete;
+
+    ~arena_allocator() {
+        release();
+    }
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        if(ptr == nullptr) {
+            return nsize == 0 ? nullptr : bump(nsize);
+        }
+
+        if(nsize == 0) {
+            if(is_last(ptr, osize)) {
+                cursor -= round(osize);
+                used_bytes -= round(osize);
+            }
+            return nullptr;
+        }
+
+        if(round(nsize) <= round(osize)) {
+            if(is_last(ptr, osize)) {
+                cursor -= round(osize) - round(nsize);
+                used_bytes -= round(osize) - round(nsize);
+            }
+            return ptr;
+        }
+
+        if(is_last(ptr, osize) && static_cast<std::size_t>(end - static_cast<char*>(ptr)) >= round(nsize)) {
+            cursor = static_cast<char*>(ptr) + round(nsize);
+            used_bytes += round(nsize) - round(osize);
+            return ptr;
+        }
+
+        void* result = bump(nsize);
+        if(result != nullptr) {
+            std::memcpy(result, ptr, osize);
+        }
+        return result;
+    }
+
+    // forgets every allocation but keeps the most recent chunk around for the next state
+    // only call this once the state using the arena has been closed
+    void reset() noexcept {
+        if(head == nullptr) {
+            return;
+        }
+        free_chunks(head->next);
+        head->next = nullptr;
+        cursor = reinterpret_cast<char*>(head) + header_size();
+        end = reinterpret_cast<char*>(head) + head->size;
+        used_bytes = 0;
+    }
+
+    // returns every chunk to the system
+    // only call this once the state using the arena has been closed
+    void release() noexcept {
+        free_chunks(head);
+        head = nullptr;
+        cursor = nullptr;
+        end = nullptr;
+        used_bytes = 0;
+    }
+
+    std::size_t reserved() const noexcept {
+        return reserved_bytes;
+    }
+
+    std::size_t used() const noexcept {
+        return used_bytes;
+    }
+};
+
+struct memory_stats {
+    std::size_t current;
+    std::size_t peak;
+    std::size_t limit;
+    std::size_t allocations;
+    std::size_t deallocations;
+    std::size_t failures;
+};
+
+// Allocation layer that accounts for every byte a state holds and optionally caps it.
+// Allocations that would go over the limit fail, which lua reports as a memory error
+// (sol::memory_error) after attempting an emergency collection. A limit of 0 means unlimited.
+// The counters are only written by the thread running the state but can be read from any thread.
+class memory_tracker {
+private:
+    lua_Alloc upstream;
+    void* upstream_data;
+    std::atomic<std::size_t> current_bytes;
+    std::atomic<std::size_t> peak_bytes;
+    std::atomic<std::size_t> max_bytes;
+    std::atomic<std::size_t> allocation_count;
+    std::atomic<std::size_t> deallocation_count;
+    std::atomic<std::size_t> failure_count;
+
+    static void increment(std::atomic<std::size_t>& counter) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+public:
+    explicit memory_tracker(std::size_t limit = 0): memory_tracker(&detail::default_allocate, nullptr, limit) {}
+
+    memory_tracker(lua_Alloc allocator, void* userdata, std::size_t limit = 0):
+    upstream(allocator), upstream_data(userdata), current_bytes(0), peak_bytes(0), max_bytes(limit),
+    allocation_count(0), deallocation_count(0), failure_count(0) {}
+
+    // layers the accounting on top of another allocator object, such as a pool_allocator
+    template<typename Allocator, DisableIf<std::is_same<Allocator, memory_tracker>> = 0>
+    explicit memory_tracker(Allocator& allocator, std::size_t limit = 0):
+    memory_tracker(&detail::allocate<Allocator>, std::addressof(allocator), limit) {}
+
+    memory_tracker(const memory_tracker&) = delete;
+    memory_tracker& operator=(const memory_tracker&) = delete;
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        std::size_t old_size = ptr == nullptr ? 0 : osize;
+        std::size_t current = current_bytes.load(std::memory_order_relaxed);
+        if(nsize > old_size) {
+            std::size_t limit = max_bytes.load(std::memory_order_relaxed);
+            if(limit != 0 && current - old_size + nsize > limit) {
+                increment(failure_count);
+                return nullptr;
+            }
+        }
+
+        void* result = upstream(upstream_data, ptr, osize, nsize);
+        if(result == nullptr && nsize != 0) {
+            increment(failure_count);
+            return nullptr;
+        }
+
+        current = current - old_size + nsize;
+        current_bytes.store(current, std::memory_order_relaxed);
+        if(current > peak_bytes.load(std::memory_order_relaxed)) {
+            peak_bytes.store(current, std::memory_order_relaxed);
+        }
+        if(ptr == nullptr) {
+            increment(allocation_count);
+        }
+        else if(nsize == 0) {
+            increment(deallocation_count);
+        }
+        return result;
+    }
+
+    std::size_t current() const noexcept {
+        return current_bytes.load(std::memory_order_relaxed);
+    }
+
+    std::size_t peak() const noexcept {
+        return peak_bytes.load(std::memory_order_relaxed);
+    }
+
+    std::size_t limit() const noexcept {
+        return max_bytes.load(std::memory_order_relaxed);
+    }
+
+    // lowering the limit below the current usage only makes new allocations fail
+    void limit(std::size_t bytes) noexcept {
+        max_bytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    void reset_peak() noexcept {
+        peak_bytes.store(current(), std::memory_order_relaxed);
+    }
+
+    memory_stats stats() const noexcept {
+        return {
+            current(),
+            peak(),
+            limit(),
+            allocation_count.load(std::memory_order_relaxed),
+            deallocation_count.load(std::memory_order_relaxed),
+            failure_count.load(std::memory_order_relaxed)
+        };
+    }
+};
+} // sol
+
+#endif // SOL_ALLOCATOR_HPP
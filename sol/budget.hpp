@@ -0,0 +1,179 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_BUDGET_HPP
+#define SOL_BUDGET_HPP
+
+#include "hook.hpp"
+#include "error.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+namespace sol {
+enum class budget_exceeded {
+    none,
+    instructions,
+    deadline,
+    preempted
+};
+
+class budget_error : public error {
+private:
+    budget_exceeded why;
+public:
+    budget_error(budget_exceeded reason, const std::string& message): error(message), why(reason) {}
+
+    budget_exceeded reason() const noexcept {
+        return why;
+    }
+};
+
+// Limits how long code run through run may execute, by instruction count, by a deadline
+// or by preempt called from another thread. Limits are checked from a count hook every
+// granularity instructions, so they are enforced to within that many instructions and
+// a call blocked inside C code is only stopped once it returns to Lua.
+class execution_budget {
+private:
+    typedef std::chrono::steady_clock clock;
+
+    lua_State* L;
+    std::size_t max_instructions = 0;
+    clock::duration timeout = clock::duration::zero();
+    int step = 1000;
+    std::size_t used = 0;
+    clock::time_point end;
+    std::atomic<bool> preempt_requested;
+    budget_exceeded why = budget_exceeded::none;
+    int hook = 0;
+
+    static const char* describe(budget_exceeded reason) {
+        switch(reason) {
+        case budget_exceeded::instructions:
+            return "execution budget exceeded: instruction limit reached";
+        case budget_exceeded::deadline:
+            return "execution budget exceeded: deadline passed";
+        case budget_exceeded::preempted:
+            return "execution budget exceeded: preempted";
+        default:
+            return "";
+        }
+    }
+
+    static void on_count(lua_State* L, lua_Debug*, void* data) {
+        execution_budget& self = *static_cast<execution_budget*>(data);
+        if(self.why != budget_exceeded::none) {
+            // the hook runs on every instruction once a limit was hit
+            ++self.used;
+        }
+        else {
+            self.used += static_cast<std::size_t>(self.step);
+            // the request is consumed by the run it stops
+            if(self.preempt_requested.exchange(false, std::memory_order_relaxed)) {
+                self.why = budget_exceeded::preempted;
+            }
+            else if(self.max_instructions != 0 && self.used >= self.max_instructions) {
+                self.why = budget_exceeded::instructions;
+            }
+            else if(self.timeout != clock::duration::zero() && clock::now() >= self.end) {
+                self.why = budget_exceeded::deadline;
+            }
+            else {
+                return;
+            }
+            // from now on every instruction raises the error again,
+            // so a script cannot keep going by catching it with pcall
+            set_hook_count(L, self.hook, 1);
+        }
+        luaL_error(L, "%s", describe(self.why));
+    }
+
+    struct installed {
+        execution_budget& self;
+        installed(execution_budget& self): self(self) {
+            self.used = 0;
+            self.why = budget_exceeded::none;
+            self.end = clock::now() + self.timeout;
+            self.hook = add_hook(self.L, LUA_MASKCOUNT, self.step, &on_count, &self);
+        }
+        ~installed() {
+            remove_hook(self.L, self.hook);
+        }
+    };
+
+public:
+    explicit execution_budget(lua_State* L): L(L), preempt_requested(false) {}
+
+    execution_budget(const execution_budget&) = delete;
+    execution_budget& operator=(const execution_budget&) = delete;
+
+    // 0 means no instruction limit
+    execution_budget& instructions(std::size_t limit) {
+        max_instructions = limit;
+        return *this;
+    }
+
+    // measured from the start of each run, zero means no deadline
+    template<typename Rep, typename Period>
+    execution_budget& deadline(std::chrono::duration<Rep, Period> after) {
+        timeout = std::chrono::duration_cast<clock::duration>(after);
+        return *this;
+    }
+
+    // instructions between checks, lower is more precise and more expensive
+    execution_budget& granularity(int instructions) {
+        if(instructions <= 0) {
+            throw error("the budget granularity must be above zero");
+        }
+        step = instructions;
+        return *this;
+    }
+
+    // stops the current run at its next check, or the next run if none is going on;
+    // safe to call from any thread
+    void preempt() noexcept {
+        preempt_requested.store(true, std::memory_order_relaxed);
+    }
+
+    // instructions executed by the last run, rounded up to the granularity
+    std::size_t instructions_used() const noexcept {
+        return used;
+    }
+
+    // Calls fx, usually a state::script or sol::function call, under the budget.
+    // Throws budget_error if a limit was hit, other errors pass through unchanged.
+    template<typename Fx>
+    auto run(Fx&& fx) -> decltype(fx()) {
+        installed guard(*this);
+        try {
+            return fx();
+        }
+        catch(const error&) {
+            if(why != budget_exceeded::none) {
+                throw budget_error(why, describe(why));
+            }
+            throw;
+        }
+    }
+};
+} // sol
+
+#endif // SOL_BUDGET_HPP
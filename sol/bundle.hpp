@@ -0,0 +1,319 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_BUNDLE_HPP
+#define SOL_BUNDLE_HPP
+
+#include "types.hpp"
+#include "error.hpp"
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace sol {
+// Bundle layout, in native byte order:
+// header  | magic "SOLB", version, module count, bucket count
+// buckets | open addressed hash index of bundle_entry, bucket count is a power of two
+// blob    | module names and chunks referenced by offsets from the start of the bundle
+namespace detail {
+const char bundle_magic[4] = { 'S', 'O', 'L', 'B' };
+const std::uint32_t bundle_version = 1;
+
+struct bundle_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t count;
+    std::uint32_t buckets;
+};
+
+struct bundle_entry {
+    std::uint32_t hash;
+    std::uint32_t flags;
+    std::uint32_t name_offset;
+    std::uint32_t name_size;
+    std::uint32_t data_offset;
+    std::uint32_t data_size;
+};
+
+// FNV-1a
+inline std::uint32_t bundle_hash(const char* str, std::size_t size) noexcept {
+    std::uint32_t hash = 2166136261u;
+    for(std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+} // detail
+
+enum class chunk : std::uint32_t {
+    source = 1,
+    binary = 2
+};
+
+class bundle {
+private:
+    detail::mapped_file file;
+    const char* bytes = nullptr;
+    std::size_t length = 0;
+    detail::bundle_header header;
+
+    detail::bundle_entry entry_at(std::uint32_t bucket) const noexcept {
+        detail::bundle_entry e;
+        std::memcpy(&e, bytes + sizeof(header) + bucket * sizeof(e), sizeof(e));
+        return e;
+    }
+
+    bool in_bounds(std::uint32_t offset, std::uint32_t size) const noexcept {
+        return offset <= length && size <= length - offset;
+    }
+
+    void validate() {
+        if(length < sizeof(header)) {
+            throw error("bundle is too small to contain a header");
+        }
+        std::memcpy(&header, bytes, sizeof(header));
+        if(std::memcmp(header.magic, detail::bundle_magic, sizeof(header.magic)) != 0) {
+            throw error("bundle has an invalid signature");
+        }
+        if(header.version != detail::bundle_version) {
+            throw error("bundle version is not supported");
+        }
+        if(header.buckets == 0 || (header.buckets & (header.buckets - 1)) != 0 || header.count > header.buckets) {
+            throw error("bundle index is malformed");
+        }
+        std::size_t index_size = static_cast<std::size_t>(header.buckets) * sizeof(detail::bundle_entry);
+        if(index_size / sizeof(detail::bundle_entry) != header.buckets || length - sizeof(header) < index_size) {
+            throw error("bundle index is truncated");
+        }
+        for(std::uint32_t i = 0; i < header.buckets; ++i) {
+            detail::bundle_entry e = entry_at(i);
+            if(e.flags != 0 && (!in_bounds(e.name_offset, e.name_size) || !in_bounds(e.data_offset, e.data_size))) {
+                throw error("bundle entry points outside of the bundle");
+            }
+        }
+    }
+
+    int load(lua_State* L, const detail::bundle_entry& e) const {
+        std::string chunkname = "@";
+        chunkname.append(bytes + e.name_offset, e.name_size);
+        const char* mode = e.flags == static_cast<std::uint32_t>(chunk::binary) ? "b" : "t";
+        return luaL_loadbufferx(L, bytes + e.data_offset, e.data_size, chunkname.c_str(), mode);
+    }
+
+    static int searcher(lua_State* L) {
+        const bundle& self = *static_cast<const bundle*>(lua_touserdata(L, lua_upvalueindex(1)));
+        std::size_t size;
+        const char* name = luaL_checklstring(L, 1, &size);
+        detail::bundle_entry e;
+        if(!self.find(name, size, e)) {
+            lua_pushfstring(L, "\n\tno module '%s' in bundle", name);
+            return 1;
+        }
+        if(self.load(L, e) != LUA_OK) {
+            return luaL_error(L, "error loading module '%s' from bundle:\n\t%s", name, lua_tostring(L, -1));
+        }
+        lua_pushvalue(L, 1);
+        return 2;
+    }
+public:
+    explicit bundle(const std::string& filename): file(filename), bytes(file.data()), length(file.size()) {
+        validate();
+    }
+
+    // does not take ownership, the memory must outlive the bundle
+    bundle(const char* data, std::size_t size): bytes(data), length(size) {
+        validate();
+    }
+
+    bundle(const bundle&) = delete;
+    bundle& operator=(const bundle&) = delete;
+
+    std::size_t size() const noexcept {
+        return header.count;
+    }
+
+    bool contains(const std::string& name) const noexcept {
+        detail::bundle_entry e;
+        return find(name.data(), name.size(), e);
+    }
+
+    bool find(const char* name, std::size_t size, detail::bundle_entry& result) const noexcept {
+        std::uint32_t hash = detail::bundle_hash(name, size);
+        std::uint32_t mask = header.buckets - 1;
+        for(std::uint32_t probe = 0, bucket = hash & mask; probe < header.buckets; ++probe, bucket = (bucket + 1) & mask) {
+            detail::bundle_entry e = entry_at(bucket);
+            if(e.flags == 0) {
+                return false;
+            }
+            if(e.hash == hash && e.name_size == size && std::memcmp(bytes + e.name_offset, name, size) == 0) {
+                result = e;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // pushes the chunk of the module as a function, or throws if it is missing or invalid
+    void load(lua_State* L, const std::string& name) const {
+        detail::bundle_entry e;
+        if(!find(name.data(), name.size(), e)) {
+            throw error("no module '" + name + "' in bundle");
+        }
+        if(load(L, e) != LUA_OK) {
+            std::string err = lua_tostring(L, -1);
+            lua_pop(L, 1);
+            throw error(err);
+        }
+    }
+
+    // inserts a searcher into package.searchers right after the preload searcher
+    // the bundle must outlive the lua_State
+    void add_searcher(lua_State* L) const {
+        lua_getglobal(L, "package");
+        if(!lua_istable(L, -1)) {
+            lua_pop(L, 1);
+            throw error("the package library must be opened before adding a bundle searcher");
+        }
+        lua_getfield(L, -1, "searchers");
+        if(!lua_istable(L, -1)) {
+            lua_pop(L, 2);
+            throw error("package.searchers is not a table");
+        }
+        int searchers = lua_gettop(L);
+        int position = 2;
+        int last = static_cast<int>(lua_rawlen(L, searchers));
+        for(int i = last; i >= position; --i) {
+            lua_rawgeti(L, searchers, i);
+            lua_rawseti(L, searchers, i + 1);
+        }
+        if(last < position) {
+            position = last + 1;
+        }
+        lua_pushlightuserdata(L, const_cast<bundle*>(this));
+        lua_pushcclosure(L, &bundle::searcher, 1);
+        lua_rawseti(L, searchers, position);
+        lua_pop(L, 2);
+    }
+};
+
+class bundle_writer {
+private:
+    struct module {
+        std::string name;
+        std::string data;
+        chunk type;
+    };
+    std::vector<module> modules;
+
+    template<typename T>
+    static void append(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    static void write_at(std::string& out, std::size_t offset, const T& value) {
+        std::memcpy(&out[offset], &value, sizeof(value));
+    }
+public:
+    bundle_writer& add(std::string name, std::string data, chunk type = chunk::source) {
+        if(name.empty()) {
+            throw error("bundled modules must have a name");
+        }
+        for(auto&& m : modules) {
+            if(m.name == name) {
+                throw error("module '" + name + "' is already in the bundle");
+            }
+        }
+        modules.push_back({ std::move(name), std::move(data), type });
+        return *this;
+    }
+
+    std::size_t size() const noexcept {
+        return modules.size();
+    }
+
+    std::string str() const {
+        std::uint32_t buckets = 1;
+        while(buckets < modules.size() * 2) {
+            buckets <<= 1;
+        }
+
+        std::string out;
+        detail::bundle_header header;
+        std::memcpy(header.magic, detail::bundle_magic, sizeof(header.magic));
+        header.version = detail::bundle_version;
+        header.count = static_cast<std::uint32_t>(modules.size());
+        header.buckets = buckets;
+        append(out, header);
+
+        std::size_t index = out.size();
+        out.resize(index + buckets * sizeof(detail::bundle_entry), '\0');
+
+        std::uint32_t mask = buckets - 1;
+        for(auto&& m : modules) {
+            if(out.size() + m.name.size() + m.data.size() > UINT32_MAX) {
+                throw error("bundle is too large");
+            }
+            detail::bundle_entry e;
+            e.hash = detail::bundle_hash(m.name.data(), m.name.size());
+            e.flags = static_cast<std::uint32_t>(m.type);
+            e.name_offset = static_cast<std::uint32_t>(out.size());
+            e.name_size = static_cast<std::uint32_t>(m.name.size());
+            out.append(m.name);
+            e.data_offset = static_cast<std::uint32_t>(out.size());
+            e.data_size = static_cast<std::uint32_t>(m.data.size());
+            out.append(m.data);
+
+            std::uint32_t bucket = e.hash & mask;
+            for(;;) {
+                std::uint32_t flags;
+                std::size_t position = index + bucket * sizeof(detail::bundle_entry);
+                std::memcpy(&flags, &out[position + offsetof(detail::bundle_entry, flags)], sizeof(flags));
+                if(flags == 0) {
+                    write_at(out, position, e);
+                    break;
+                }
+                bucket = (bucket + 1) & mask;
+            }
+        }
+        return out;
+    }
+
+    void write(const std::string& filename) const {
+        std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!file) {
+            throw error("unable to open file for writing: " + filename);
+        }
+        std::string contents = str();
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if(!file) {
+            throw error("unable to write bundle: " + filename);
+        }
+    }
+};
+} // sol
+
+#endif // SOL_BUNDLE_HPP
@@ -0,0 +1,175 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_DESTRUCTION_QUEUE_HPP
+#define SOL_DESTRUCTION_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace sol {
+// Userdata of a type with deferred_destruct<T> set are not destroyed inside the
+// collector. Their __gc moves the object into default_destruction_queue() and only
+// the moved-from shell is destroyed in place, so T's move should leave nothing
+// expensive behind. Opt in with
+//     template<> struct deferred_destruct<image> : std::true_type {};
+template<typename T>
+struct deferred_destruct : std::false_type {};
+
+// Objects waiting to be destroyed. Any thread can push without locking, and
+// drain destroys everything pushed so far, either when called explicitly or from
+// the background thread started by start.
+class destruction_queue {
+private:
+    struct node {
+        node* next = nullptr;
+        virtual ~node() {}
+    };
+
+    template<typename T>
+    struct holder : node {
+        T value;
+        holder(T&& value): value(std::move(value)) {}
+    };
+
+    std::atomic<node*> head;
+    std::atomic<std::size_t> waiting;
+    std::atomic<std::size_t> peak;
+    std::atomic<std::size_t> total;
+    std::mutex drain_mutex;
+    std::mutex worker_mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool stopping = false;
+
+    void link(node* n) {
+        std::size_t depth = waiting.fetch_add(1, std::memory_order_relaxed) + 1;
+        std::size_t highest = peak.load(std::memory_order_relaxed);
+        while(depth > highest && !peak.compare_exchange_weak(highest, depth, std::memory_order_relaxed)) {}
+
+        n->next = head.load(std::memory_order_relaxed);
+        while(!head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+public:
+    destruction_queue() noexcept: head(nullptr), waiting(0), peak(0), total(0) {}
+
+    destruction_queue(const destruction_queue&) = delete;
+    destruction_queue& operator=(const destruction_queue&) = delete;
+
+    ~destruction_queue() {
+        stop();
+        drain();
+    }
+
+    // takes ownership of value, which is destroyed by a later drain
+    template<typename T>
+    void push(T&& value) {
+        typedef typename std::decay<T>::type U;
+        link(new holder<U>(std::forward<T>(value)));
+    }
+
+    // destroys everything pushed so far in the order it was pushed,
+    // returns how many objects were destroyed
+    std::size_t drain() {
+        std::lock_guard<std::mutex> lock(drain_mutex);
+        node* list = head.exchange(nullptr, std::memory_order_acquire);
+        node* ordered = nullptr;
+        while(list != nullptr) {
+            node* next = list->next;
+            list->next = ordered;
+            ordered = list;
+            list = next;
+        }
+
+        std::size_t count = 0;
+        while(ordered != nullptr) {
+            node* next = ordered->next;
+            delete ordered;
+            ordered = next;
+            ++count;
+        }
+        waiting.fetch_sub(count, std::memory_order_relaxed);
+        total.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    // starts a thread that drains the queue every interval until stop is called
+    void start(std::chrono::milliseconds interval = std::chrono::milliseconds(10)) {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        if(worker.joinable()) {
+            return;
+        }
+        stopping = false;
+        worker = std::thread([this, interval] {
+            std::unique_lock<std::mutex> lock(worker_mutex);
+            while(!stopping) {
+                wake.wait_for(lock, interval);
+                lock.unlock();
+                drain();
+                lock.lock();
+            }
+        });
+    }
+
+    // stops the background thread, objects still queued stay there until the next drain
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(worker_mutex);
+            if(!worker.joinable()) {
+                return;
+            }
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        worker = std::thread();
+    }
+
+    // objects waiting to be destroyed
+    std::size_t pending() const noexcept {
+        return waiting.load(std::memory_order_relaxed);
+    }
+
+    // the most objects that have been waiting at once
+    std::size_t peak_pending() const noexcept {
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    // objects destroyed by drain so far
+    std::size_t destroyed() const noexcept {
+        return total.load(std::memory_order_relaxed);
+    }
+};
+
+inline destruction_queue& default_destruction_queue() {
+    static destruction_queue queue;
+    return queue;
+}
+} // sol
+
+#endif // SOL_DESTRUCTION_QUEUE_HPP
@@ -0,0 +1,100 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_ENVIRONMENT_HPP
+#define SOL_ENVIRONMENT_HPP
+
+#include "table.hpp"
+#include "function.hpp"
+
+namespace sol {
+namespace detail {
+inline int read_only_newindex(lua_State* L) {
+    return luaL_error(L, "attempt to modify the shared globals");
+}
+
+// a read-only view of the fallback: reads go through, writes raise an error
+inline void push_read_only(lua_State* L, const reference& fallback) {
+    lua_createtable(L, 0, 0);
+    lua_createtable(L, 0, 3);
+    fallback.push();
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, &read_only_newindex);
+    lua_setfield(L, -2, "__newindex");
+    // keeps scripts from swapping out or inspecting the fallback through getmetatable
+    lua_pushboolean(L, 0);
+    lua_setfield(L, -2, "__metatable");
+    lua_setmetatable(L, -2);
+}
+
+inline lua_State* push_environment(lua_State* L, const reference& fallback) {
+    lua_createtable(L, 0, 1);
+    lua_createtable(L, 0, 2);
+    push_read_only(L, fallback);
+    lua_setfield(L, -2, "__index");
+    lua_pushboolean(L, 0);
+    lua_setfield(L, -2, "__metatable");
+    lua_setmetatable(L, -2);
+    // _G found through the fallback would be the shared globals themselves
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "_G");
+    return L;
+}
+} // detail
+
+// A table of globals for a chunk. Lookups that miss fall back to a shared table, usually the
+// state's globals, while assignments stay in the environment. Many environments can share one
+// state's libraries and userdata while keeping their globals apart.
+// The fallback is only reached through a read-only view, and _G is the environment itself.
+// Tables reachable through it, such as string or math, are still shared and writable.
+class environment : public table {
+public:
+    environment() noexcept = default;
+
+    environment(lua_State* L, const table& fallback): table(detail::push_environment(L, fallback), -1) {
+        lua_pop(L, 1);
+    }
+
+    // makes this environment the _ENV upvalue of the function
+    // returns false if the function has no _ENV upvalue, e.g. C functions or closures
+    // that never refer to globals
+    bool set_on(const function& fx) const {
+        lua_State* L = state();
+        fx.push();
+        for(int i = 1; ; ++i) {
+            const char* name = lua_getupvalue(L, -1, i);
+            if(name == nullptr) {
+                lua_pop(L, 1);
+                return false;
+            }
+            lua_pop(L, 1);
+            if(std::char_traits<char>::compare(name, "_ENV", 5) == 0) {
+                push();
+                lua_setupvalue(L, -2, i);
+                lua_pop(L, 1);
+                return true;
+            }
+        }
+    }
+};
+} // sol
+
+#endif // SOL_ENVIRONMENT_HPP
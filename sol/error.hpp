@@ -30,6 +30,11 @@ class error : public std::runtime_error {
 public:
     error(const std::string& str): std::runtime_error("lua: error: " + str) {}
 };
+
+class memory_error : public error {
+public:
+    memory_error(const std::string& str): error(str) {}
+};
 } // sol
 
 #endif // SOL_ERROR_HPP
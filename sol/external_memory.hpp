@@ -0,0 +1,101 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_EXTERNAL_MEMORY_HPP
+#define SOL_EXTERNAL_MEMORY_HPP
+
+#include "types.hpp"
+#include <cstddef>
+#include <new>
+
+namespace sol {
+// Reports heap memory owned by a userdata that the collector cannot see, e.g.
+//     template<> struct external_memory_traits<image> {
+//         static std::size_t size(const image& i) { return i.pixels.size(); }
+//     };
+// The size is added when the userdata is created and removed by its __gc, so it
+// must not change in between. Objects that grow should use add_external_memory.
+template<typename T>
+struct external_memory_traits {
+    static std::size_t size(const T&) noexcept {
+        return 0;
+    }
+};
+
+namespace detail {
+const char external_memory_key[] = "sol.external_memory";
+
+struct external_memory_state {
+    std::size_t current = 0;
+    std::size_t debt = 0;
+};
+
+inline external_memory_state& external_memory_of(lua_State* L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, external_memory_key);
+    void* memory = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if(memory == nullptr) {
+        memory = lua_newuserdata(L, sizeof(external_memory_state));
+        new (memory) external_memory_state();
+        lua_setfield(L, LUA_REGISTRYINDEX, external_memory_key);
+    }
+    return *static_cast<external_memory_state*>(memory);
+}
+} // detail
+
+// Accounts for bytes held outside of the state and has the collector do the work
+// it would have done had they been allocated inside it, a step per whole kilobyte.
+// Nothing is stepped while the collector is stopped.
+inline void add_external_memory(lua_State* L, std::size_t bytes) {
+    if(bytes == 0) {
+        return;
+    }
+    detail::external_memory_state& state = detail::external_memory_of(L);
+    state.current += bytes;
+    state.debt += bytes;
+    if(state.debt < 1024) {
+        return;
+    }
+    int kb = static_cast<int>(state.debt / 1024);
+    state.debt %= 1024;
+    if(lua_gc(L, LUA_GCISRUNNING, 0) != 0) {
+        lua_gc(L, LUA_GCSTEP, kb);
+    }
+}
+
+// also called from __gc, so it never runs the collector
+inline void remove_external_memory(lua_State* L, std::size_t bytes) {
+    if(bytes == 0) {
+        return;
+    }
+    detail::external_memory_state& state = detail::external_memory_of(L);
+    state.current = bytes < state.current ? state.current - bytes : 0;
+}
+
+inline std::size_t external_memory(lua_State* L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, detail::external_memory_key);
+    void* memory = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return memory == nullptr ? 0 : static_cast<detail::external_memory_state*>(memory)->current;
+}
+} // sol
+
+#endif // SOL_EXTERNAL_MEMORY_HPP
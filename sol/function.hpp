@@ -36,7 +36,11 @@ namespace sol {
 class function : public reference {
 private:
     void luacall(std::size_t argcount, std::size_t resultcount) const {
-        lua_call(state(), static_cast<uint32_t>(argcount), static_cast<uint32_t>(resultcount));
+        SOL_TRACE_SCOPE(trace_kind::function_call, reinterpret_cast<std::uintptr_t>(lua_topointer(state(), -static_cast<int>(argcount) - 1)), argcount);
+        int status = lua_pcall(state(), static_cast<int>(argcount), static_cast<int>(resultcount), 0);
+        if(status != LUA_OK) {
+            detail::throw_status(state(), status);
+        }
     }
 
     template<typename... Ret>
@@ -79,6 +83,7 @@ public:
 
     template<typename... Ret, typename... Args>
     typename return_type<Ret...>::type call(Args&&... args) const {
+        stack_guard guard(state());
         push();
         stack::push_args(state(), std::forward<Args>(args)...);
         return invoke(types<Ret...>(), sizeof...(Args));
@@ -147,7 +152,7 @@ struct pusher<function_sig_t<Sigs...>> {
     static void set_isconvertible_fx(std::false_type, types<R(Args...)>, lua_State* L, Fx&& fx) {
         typedef Decay<Unwrap<Fx>> fx_t;
         std::unique_ptr<base_function> sptr(new functor_function<fx_t>(std::forward<Fx>(fx)));
-        set_fx<Fx>(L, std::move(sptr));
+        set_fx(L, std::move(sptr));
     }
 
     template<typename Fx, typename T>
@@ -159,7 +164,7 @@ struct pusher<function_sig_t<Sigs...>> {
     static void set_reference_fx(std::false_type, lua_State* L, Fx&& fx, T&& obj) {
         typedef typename std::remove_pointer<Decay<Fx>>::type clean_fx;
         std::unique_ptr<base_function> sptr(new member_function<clean_fx, T>(std::forward<T>(obj), std::forward<Fx>(fx)));
-        return set_fx<Fx>(L, std::move(sptr));
+        return set_fx(L, std::move(sptr));
     }
 
     template<typename Fx, typename T>
@@ -177,6 +182,7 @@ struct pusher<function_sig_t<Sigs...>> {
         int upvalues = stack::detail::push_as_upvalues(L, memfxptr);
         stack::push(L, userobjdata);
         ++upvalues;
+        upvalues += sol::detail::default_metrics::reserve(L);
         stack::push(L, freefunc, upvalues);
     }
 
@@ -186,26 +192,27 @@ struct pusher<function_sig_t<Sigs...>> {
         lua_CFunction freefunc = &static_function<Fx>::call;
 
         int upvalues = stack::detail::push_as_upvalues(L, target);
+        upvalues += sol::detail::default_metrics::reserve(L);
         stack::push(L, freefunc, upvalues);
     }
 
-    template<typename Fx>
+    // every functor shares one metatable, so no code or static names are made per functor type
     static void set_fx(lua_State* L, std::unique_ptr<base_function> luafunc) {
-        auto&& metakey = userdata_traits<Unqualified<Fx>>::metatable;
-        const char* metatablename = std::addressof(metakey[0]);
+        const char* metatablename = userdata_traits<base_function>::metatable.c_str();
         base_function* target = luafunc.release();
         void* userdata = reinterpret_cast<void*>(target);
-        lua_CFunction freefunc = &base_function::call;
+        lua_CFunction freefunc = &base_function::metered_call<sol::detail::default_metrics>;
 
         if(luaL_newmetatable(L, metatablename) == 1) {
             lua_pushstring(L, "__gc");
             stack::push(L, &base_function::gc);
             lua_settable(L, -3);
-            lua_pop(L, 1);
         }
+        lua_pop(L, 1);
 
         stack::detail::push_userdata<void*>(L, metatablename, userdata);
-        stack::push(L, freefunc, 1);
+        int upvalues = 1 + sol::detail::default_metrics::reserve(L);
+        stack::push(L, freefunc, upvalues);
     }
 
     template<typename... Args>
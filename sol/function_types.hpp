@@ -23,6 +23,8 @@
 #define SOL_FUNCTION_TYPES_HPP
 
 #include "stack.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include <memory>
 #include <unordered_map>
 
@@ -119,7 +121,7 @@ struct functor<T, Func, typename std::enable_if<std::is_function<Func>::value ||
 } // detail
 
 
-template<typename Function>
+template<typename Function, typename Metrics = detail::default_metrics>
 struct static_function {
     typedef typename std::remove_pointer<typename std::decay<Function>::type>::type function_type;
     typedef function_traits<function_type> traits_type;
@@ -149,7 +151,9 @@ struct static_function {
 
     static int call(lua_State* L) {
         auto udata = stack::detail::get_as_upvalues<function_type*>(L);
+        typename Metrics::scope measure(L, udata.second);
         function_type* fx = udata.first;
+        SOL_TRACE_SCOPE(trace_kind::binding_call, reinterpret_cast<std::uintptr_t>(fx), lua_gettop(L));
         int r = typed_call(tuple_types<typename traits_type::return_type>(), typename traits_type::args_type(), fx, L);
         return r;
     }
@@ -159,7 +163,7 @@ struct static_function {
     }
 };
 
-template<typename T, typename Function>
+template<typename T, typename Function, typename Metrics = detail::default_metrics>
 struct static_member_function {
     typedef typename std::remove_pointer<typename std::decay<Function>::type>::type function_type;
     typedef function_traits<function_type> traits_type;
@@ -192,8 +196,12 @@ struct static_member_function {
     static int call(lua_State* L) {
         auto memberdata = stack::detail::get_as_upvalues<function_type>(L, 1);
         auto objdata = stack::detail::get_as_upvalues<T*>(L, memberdata.second);
+        typename Metrics::scope measure(L, objdata.second);
         function_type& memfx = memberdata.first;
         T& obj = *objdata.first;
+        // a member pointer cannot be cast to an integer, its first word is the function
+        // for non-virtual members and stays the same for every object it is bound to
+        SOL_TRACE_SCOPE(trace_kind::binding_call, reinterpret_cast<std::uintptr_t>(lua_touserdata(L, lua_upvalueindex(1))), lua_gettop(L));
         int r = typed_call(tuple_types<typename traits_type::return_type>(), typename traits_type::args_type(), obj, memfx, L);
         return r;
     }
@@ -211,6 +219,7 @@ struct base_function {
 
         base_function* pfx = static_cast<base_function*>(inheritancedata);
         base_function& fx = *pfx;
+        SOL_TRACE_SCOPE(trace_kind::binding_call, reinterpret_cast<std::uintptr_t>(pfx), lua_gettop(L));
         int r = fx(L);
         return r;
     }
@@ -222,6 +231,7 @@ struct base_function {
 
         base_function* pfx = static_cast<base_function*>(inheritancedata);
         base_function& fx = *pfx;
+        SOL_TRACE_SCOPE(trace_kind::binding_call, reinterpret_cast<std::uintptr_t>(pfx), lua_gettop(L));
         int r = fx(L, detail::ref_call);
         return r;
     }
@@ -242,33 +252,38 @@ struct base_function {
         return base_call(L, *pinheritancedata);
     }
 
+    // call with the Metrics policy, which keeps its data after the function's upvalue
+    template<typename Metrics>
+    static int metered_call(lua_State* L) {
+        typename Metrics::scope measure(L, 2);
+        return call(L);
+    }
+
     static int gc(lua_State* L) {
         void** pudata = static_cast<void**>(stack::get<userdata_t>(L, 1).value);
         return base_gc(L, *pudata);
     }
 
-    template<int I>
-    struct userdata {
-        static int call(lua_State* L) {
-            // Zero-based template parameter, but upvalues start at 1
-            return base_call(L, stack::get<upvalue_t>(L, I + 1));
-        }
+    // closures made for userdata functions carry their own function as their only upvalue
+    static int upvalue_call(lua_State* L) {
+        return base_call(L, stack::get<upvalue_t>(L, 1));
+    }
 
-        static int ref_call(lua_State* L) {
-            return ref_base_call(L, stack::get<upvalue_t>(L, I + 1));
-        }
+    static int upvalue_ref_call(lua_State* L) {
+        return ref_base_call(L, stack::get<upvalue_t>(L, 1));
+    }
 
-        static int gc(lua_State* L) {
-            for(int i = 0; i < I; ++i) {
-                upvalue_t up = stack::get<upvalue_t>(L, i + 1);
-                base_function* obj = static_cast<base_function*>(up.value);
-                std::allocator<base_function> alloc{};
-                alloc.destroy(obj);
-                alloc.deallocate(obj, 1);
-            }
-            return 0;
+    // deletes every function held as an upvalue of the running closure
+    static int upvalues_gc(lua_State* L) {
+        for(int i = 1; lua_type(L, lua_upvalueindex(i)) != LUA_TNONE; ++i) {
+            upvalue_t up = stack::get<upvalue_t>(L, i);
+            base_function* obj = static_cast<base_function*>(up.value);
+            std::allocator<base_function> alloc{};
+            alloc.destroy(obj);
+            alloc.deallocate(obj, 1);
         }
-    };
+        return 0;
+    }
 
     virtual int operator()(lua_State*) {
         throw error("failure to call specialized wrapped C++ function from Lua");
@@ -509,22 +524,43 @@ struct userdata_indexing_function : public userdata_function_core<Function, Tp>
 
     std::string name;
     std::unordered_map<std::string, std::pair<std::unique_ptr<base_function>, bool>> functions;
+    // reused by every lookup so that names too long for the small string buffer allocate once
+    std::string accessor;
 
     template<typename... FxArgs>
     userdata_indexing_function(std::string name, FxArgs&&... fxargs): base_t(std::forward<FxArgs>(fxargs)...), name(std::move(name)) {}
 
     template<typename Tx>
     int fx_call(lua_State* L) {
-        std::string accessor = stack::get<std::string>(L, 1 - lua_gettop(L));
+        std::string::size_type length = 0;
+        const char* key = lua_tolstring(L, 1 - lua_gettop(L), &length);
+        accessor.assign(key == nullptr ? "" : key, length);
         auto function = functions.find(accessor);
         if(function != functions.end()) {
             if(function->second.second) {
+                // the closure for a method is made once per metatable and kept by name in the
+                // cache table of the __index closure, so it goes away with the function it calls
+                const int cache = lua_upvalueindex(2);
+                bool cached = lua_type(L, cache) == LUA_TTABLE;
+                if(cached) {
+                    lua_pushvalue(L, 2);
+                    lua_rawget(L, cache);
+                    if(!lua_isnil(L, -1)) {
+                        return 1;
+                    }
+                    lua_pop(L, 1);
+                }
                 stack::push<upvalue_t>(L, function->second.first.get());
                 if(std::is_same<T*, Tx>::value) {
-                    stack::push(L, &base_function::userdata<0>::ref_call, 1);
+                    stack::push(L, &base_function::upvalue_ref_call, 1);
                 }
                 else {
-                    stack::push(L, &base_function::userdata<0>::call, 1);
+                    stack::push(L, &base_function::upvalue_call, 1);
+                }
+                if(cached) {
+                    lua_pushvalue(L, 2);
+                    lua_pushvalue(L, -2);
+                    lua_rawset(L, cache);
                 }
                 return 1;
             }
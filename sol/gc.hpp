@@ -0,0 +1,167 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_GC_HPP
+#define SOL_GC_HPP
+
+#include "types.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <cstddef>
+
+namespace sol {
+struct gc_step {
+    std::size_t before = 0;
+    std::size_t after = 0;
+    std::size_t steps = 0;
+    // a full collection cycle was completed
+    bool finished = false;
+};
+
+// A handle to a state's collector. Collection steps still run explicitly while the
+// collector is stopped, so a frame loop can stop it and spend idle time in collect_for.
+class garbage_collector {
+private:
+    lua_State* L;
+
+    int swap(int what, int value) {
+        int previous = lua_gc(L, what, value);
+        lua_gc(L, what, previous);
+        return previous;
+    }
+
+public:
+    explicit garbage_collector(lua_State* L) noexcept: L(L) {}
+
+    // bytes currently allocated by the state
+    std::size_t memory() const {
+        return static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+    }
+
+    bool running() const {
+        return lua_gc(L, LUA_GCISRUNNING, 0) != 0;
+    }
+
+    garbage_collector& stop() {
+        lua_gc(L, LUA_GCSTOP, 0);
+        return *this;
+    }
+
+    garbage_collector& restart() {
+        lua_gc(L, LUA_GCRESTART, 0);
+        return *this;
+    }
+
+    // how long the collector waits before starting a new cycle, as a percentage of the
+    // memory in use after the last one
+    int pause() {
+        return swap(LUA_GCSETPAUSE, 200);
+    }
+
+    garbage_collector& pause(int percent) {
+        lua_gc(L, LUA_GCSETPAUSE, percent);
+        return *this;
+    }
+
+    // how much work each incremental step does relative to allocation, as a percentage
+    int step_multiplier() {
+        return swap(LUA_GCSETSTEPMUL, 200);
+    }
+
+    garbage_collector& step_multiplier(int percent) {
+        lua_gc(L, LUA_GCSETSTEPMUL, percent);
+        return *this;
+    }
+
+    // how much memory may grow before a generational collector does a major collection
+    int major_increment() {
+        return swap(LUA_GCSETMAJORINC, 100);
+    }
+
+    garbage_collector& major_increment(int percent) {
+        lua_gc(L, LUA_GCSETMAJORINC, percent);
+        return *this;
+    }
+
+    garbage_collector& generational() {
+        lua_gc(L, LUA_GCGEN, 0);
+        return *this;
+    }
+
+    garbage_collector& incremental() {
+        lua_gc(L, LUA_GCINC, 0);
+        return *this;
+    }
+
+    gc_step collect() {
+        SOL_TRACE_SCOPE(trace_kind::gc_step, 0, 0);
+        gc_step result;
+        result.before = memory();
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        result.after = memory();
+        result.steps = 1;
+        result.finished = true;
+        return result;
+    }
+
+    // one incremental step sized as if kb kilobytes had been allocated,
+    // 0 is the smallest step the collector takes
+    gc_step step(int kb = 0) {
+        SOL_TRACE_SCOPE(trace_kind::gc_step, 0, kb);
+        gc_step result;
+        result.before = memory();
+        result.finished = lua_gc(L, LUA_GCSTEP, kb) != 0;
+        result.after = memory();
+        result.steps = 1;
+        return result;
+    }
+
+    // runs incremental steps until the budget is spent or a cycle finishes, calling
+    // on_step with the sample of every step; the result sums them up
+    // the last step may run past the budget, smaller steps make that shorter
+    template<typename Fx>
+    gc_step collect_for(std::chrono::microseconds budget, int kb, Fx&& on_step) {
+        typedef std::chrono::steady_clock clock;
+        gc_step result;
+        result.before = memory();
+        result.after = result.before;
+        clock::time_point deadline = clock::now() + budget;
+        do {
+            gc_step sample = step(kb);
+            on_step(sample);
+            ++result.steps;
+            result.after = sample.after;
+            if(sample.finished) {
+                result.finished = true;
+                break;
+            }
+        }
+        while(clock::now() < deadline);
+        return result;
+    }
+
+    gc_step collect_for(std::chrono::microseconds budget, int kb = 0) {
+        return collect_for(budget, kb, [](const gc_step&) {});
+    }
+};
+} // sol
+
+#endif // SOL_GC_HPP
@@ -0,0 +1,337 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_HEAP_PROFILER_HPP
+#define SOL_HEAP_PROFILER_HPP
+
+#include "allocator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace sol {
+struct heap_site {
+    std::string source;
+    int line;
+    std::string type;
+    std::size_t allocations;
+    std::size_t bytes;
+    std::size_t live_bytes;
+};
+
+// Allocation layer that samples allocations by size and attributes each sample to the
+// innermost Lua function on the stack (source and current line) and to the kind of object
+// Lua asked for. On average one sample is taken every sample_rate bytes, and samples are
+// weighted so the counts and byte totals in a report estimate the unsampled workload.
+// Sampled blocks are followed until freed, which gives live bytes per site as well.
+// Growing a block that was not sampled when it was made, such as a stack allocated before
+// start(), cannot safely be traced to a line and is charged to the site "[resize]".
+// The allocator only ever sees the main thread, so allocations made inside a coroutine are
+// attributed to whatever the main thread is running. Not thread safe, like the state it serves.
+class heap_profiler {
+private:
+    typedef std::tuple<std::string, int, int> site_key;
+
+    struct site_stats {
+        double allocations;
+        double bytes;
+        double live_bytes;
+    };
+
+    struct sample {
+        std::map<site_key, site_stats>::iterator site;
+        std::size_t size;
+        double weight;
+    };
+
+    lua_Alloc upstream;
+    void* upstream_data;
+    lua_State* L = nullptr;
+    bool enabled = false;
+    std::size_t rate;
+    double countdown = 0;
+    std::minstd_rand random;
+    std::map<site_key, site_stats> by_site;
+    std::unordered_map<void*, sample> live;
+    std::size_t sampled = 0;
+    std::size_t dropped = 0;
+
+    // exponentially distributed gaps make the sampling independent of allocation patterns
+    void next_countdown() {
+        if(rate <= 1) {
+            countdown = 0;
+            return;
+        }
+        double uniform = (static_cast<double>(random() - random.min()) + 0.5) / (static_cast<double>(random.max() - random.min()) + 1.0);
+        countdown += -std::log(uniform) * static_cast<double>(rate);
+    }
+
+    // an allocation of size bytes had a 1 - e^(-size / rate) chance of being picked
+    double weight_of(std::size_t size) const {
+        if(rate <= 1) {
+            return 1.0;
+        }
+        return 1.0 / (1.0 - std::exp(-static_cast<double>(size) / static_cast<double>(rate)));
+    }
+
+    bool should_sample(std::size_t bytes) {
+        countdown -= static_cast<double>(bytes);
+        if(countdown > 0) {
+            return false;
+        }
+        next_countdown();
+        while(countdown <= 0 && rate > 1) {
+            next_countdown();
+        }
+        return true;
+    }
+
+    // only safe for new blocks: getting the source and line of an active function neither
+    // allocates nor touches the stack, but while Lua resizes a block (the stack among them)
+    // its CallInfo may still point into memory that was just released
+    site_key locate(int type) const {
+        lua_Debug ar;
+        if(L != nullptr) {
+            for(int level = 0; lua_getstack(L, level, &ar) != 0; ++level) {
+                lua_getinfo(L, "Sl", &ar);
+                if(ar.currentline >= 0) {
+                    return site_key(ar.short_src, ar.currentline, type);
+                }
+            }
+        }
+        return site_key("[C]", 0, type);
+    }
+
+    void record(void* block, std::size_t size, int type, bool resized) {
+        try {
+            double weight = weight_of(size);
+            site_key key = resized ? site_key("[resize]", 0, type) : locate(type);
+            auto site = by_site.emplace(std::move(key), site_stats{ 0, 0, 0 }).first;
+            site->second.allocations += weight;
+            site->second.bytes += weight * static_cast<double>(size);
+            site->second.live_bytes += weight * static_cast<double>(size);
+            live[block] = sample{ site, size, weight };
+            ++sampled;
+        }
+        catch(...) {
+            ++dropped;
+        }
+    }
+
+    void forget(void* block) {
+        auto it = live.find(block);
+        if(it == live.end()) {
+            return;
+        }
+        it->second.site->second.live_bytes -= it->second.weight * static_cast<double>(it->second.size);
+        live.erase(it);
+    }
+
+    // a sampled block that moves or changes size stays with the site that allocated it
+    void resize(void* ptr, void* result, std::size_t nsize) {
+        auto it = live.find(ptr);
+        if(it == live.end()) {
+            return;
+        }
+        sample s = it->second;
+        s.site->second.live_bytes += s.weight * (static_cast<double>(nsize) - static_cast<double>(s.size));
+        s.size = nsize;
+        if(result != ptr) {
+            live.erase(it);
+            try {
+                live[result] = s;
+            }
+            catch(...) {
+                s.site->second.live_bytes -= s.weight * static_cast<double>(nsize);
+                ++dropped;
+            }
+        }
+        else {
+            it->second = s;
+        }
+    }
+
+    static std::size_t round(double x) noexcept {
+        return x <= 0 ? 0 : static_cast<std::size_t>(x + 0.5);
+    }
+
+    static const char* type_name(int type) noexcept {
+        switch(type) {
+        case LUA_TSTRING:
+            return "string";
+        case LUA_TTABLE:
+            return "table";
+        case LUA_TFUNCTION:
+            return "function";
+        case LUA_TUSERDATA:
+            return "userdata";
+        case LUA_TTHREAD:
+            return "thread";
+        case LUA_NUMTAGS:
+            return "proto";
+        case LUA_NUMTAGS + 1:
+            return "upvalue";
+        default:
+            return "memory";
+        }
+    }
+
+    heap_site to_site(const std::pair<const site_key, site_stats>& s) const {
+        return heap_site{ std::get<0>(s.first), std::get<1>(s.first), type_name(std::get<2>(s.first)),
+                          round(s.second.allocations), round(s.second.bytes), round(s.second.live_bytes) };
+    }
+public:
+    explicit heap_profiler(std::size_t sample_rate = 64 * 1024): heap_profiler(&detail::default_allocate, nullptr, sample_rate) {}
+
+    heap_profiler(lua_Alloc allocator, void* userdata, std::size_t sample_rate = 64 * 1024):
+    upstream(allocator), upstream_data(userdata), rate(sample_rate) {
+        next_countdown();
+    }
+
+    // layers the profiler on top of another allocator object, such as a memory_tracker
+    template<typename Allocator, DisableIf<std::is_same<Allocator, heap_profiler>> = 0>
+    explicit heap_profiler(Allocator& allocator, std::size_t sample_rate = 64 * 1024):
+    heap_profiler(&detail::allocate<Allocator>, std::addressof(allocator), sample_rate) {}
+
+    heap_profiler(const heap_profiler&) = delete;
+    heap_profiler& operator=(const heap_profiler&) = delete;
+
+    void* operator()(void* ptr, std::size_t osize, std::size_t nsize) {
+        void* result = upstream(upstream_data, ptr, osize, nsize);
+        if(!enabled && live.empty()) {
+            return result;
+        }
+
+        if(ptr == nullptr) {
+            // osize is the type of the new object here
+            if(result != nullptr && enabled && should_sample(nsize)) {
+                record(result, nsize, static_cast<int>(osize), false);
+            }
+        }
+        else if(nsize == 0) {
+            forget(ptr);
+        }
+        else if(result != nullptr) {
+            resize(ptr, result, nsize);
+            if(enabled && nsize > osize && live.count(result) == 0 && should_sample(nsize - osize)) {
+                record(result, nsize, 0, true);
+            }
+        }
+        return result;
+    }
+
+    // the state whose stack allocations are attributed to, must use this allocator
+    void attach(lua_State* state) noexcept {
+        L = state;
+    }
+
+    void start() noexcept {
+        enabled = true;
+    }
+
+    // blocks sampled so far are still followed until freed
+    void stop() noexcept {
+        enabled = false;
+    }
+
+    bool running() const noexcept {
+        return enabled;
+    }
+
+    std::size_t sample_rate() const noexcept {
+        return rate;
+    }
+
+    // average number of bytes between samples, 1 samples every allocation
+    void sample_rate(std::size_t bytes) {
+        rate = bytes;
+        countdown = 0;
+        next_countdown();
+    }
+
+    void clear() {
+        by_site.clear();
+        live.clear();
+        sampled = dropped = 0;
+    }
+
+    std::size_t samples() const noexcept {
+        return sampled;
+    }
+
+    std::size_t dropped_samples() const noexcept {
+        return dropped;
+    }
+
+    // estimated totals per site, ordered by source, line and type
+    std::vector<heap_site> sites() const {
+        std::vector<heap_site> result;
+        result.reserve(by_site.size());
+        for(auto&& s : by_site) {
+            result.push_back(to_site(s));
+        }
+        return result;
+    }
+
+    // the n sites that allocated the most bytes, or that hold the most live bytes
+    std::vector<heap_site> top(std::size_t n, bool by_live = false) const {
+        std::vector<heap_site> result = sites();
+        auto key = [by_live](const heap_site& s) { return by_live ? s.live_bytes : s.bytes; };
+        std::stable_sort(result.begin(), result.end(), [&key](const heap_site& a, const heap_site& b) {
+            return key(a) > key(b);
+        });
+        if(result.size() > n) {
+            result.resize(n);
+        }
+        return result;
+    }
+
+    // one "source:line type allocations bytes live_bytes" line per site in a stable order,
+    // so dumps taken at different times can be compared with diff
+    std::string dump() const {
+        std::string out;
+        for(auto&& s : sites()) {
+            out += s.source;
+            out += ':';
+            out += std::to_string(s.line);
+            out += ' ';
+            out += s.type;
+            out += ' ';
+            out += std::to_string(s.allocations);
+            out += ' ';
+            out += std::to_string(s.bytes);
+            out += ' ';
+            out += std::to_string(s.live_bytes);
+            out += '\n';
+        }
+        return out;
+    }
+};
+} // sol
+
+#endif // SOL_HEAP_PROFILER_HPP
@@ -0,0 +1,172 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_HOOK_HPP
+#define SOL_HOOK_HPP
+
+#include "types.hpp"
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace sol {
+typedef void (*hook_function)(lua_State* L, lua_Debug* ar, void* data);
+
+namespace detail {
+// a static in an inline function has one address in every translation unit
+inline const void* hook_dispatcher_key() {
+    static const char key = 0;
+    return &key;
+}
+
+struct hook_entry {
+    int id;
+    int mask;
+    int count;
+    int remaining;
+    hook_function fx;
+    void* data;
+};
+
+// Lua keeps a single hook per thread, this shares it between any number of hooks.
+// The installed hook asks for the union of every mask and, for count hooks, the
+// smallest count, and each count hook is called once its own count has passed,
+// so counts that are not multiples of the smallest one are rounded up to them.
+class hook_dispatcher {
+private:
+    std::vector<hook_entry> entries;
+    int next_id = 1;
+    int count = 0;
+
+    static hook_dispatcher* find(lua_State* L) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, hook_dispatcher_key());
+        void* self = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        return static_cast<hook_dispatcher*>(self);
+    }
+
+    static int destroy(lua_State* L) {
+        static_cast<hook_dispatcher*>(lua_touserdata(L, 1))->~hook_dispatcher();
+        return 0;
+    }
+
+    static int event_mask(int event) {
+        return event == LUA_HOOKTAILCALL ? LUA_MASKCALL : 1 << event;
+    }
+
+    // hooks may raise Lua errors, so nothing here may need destructing
+    static void dispatch(lua_State* L, lua_Debug* ar) {
+        hook_dispatcher* self = find(L);
+        if(self == nullptr) {
+            return;
+        }
+        if(ar->event == LUA_HOOKCOUNT) {
+            for(std::size_t i = 0; i < self->entries.size(); ++i) {
+                hook_entry& e = self->entries[i];
+                if((e.mask & LUA_MASKCOUNT) != 0 && (e.remaining -= self->count) <= 0) {
+                    e.remaining = e.count;
+                    e.fx(L, ar, e.data);
+                }
+            }
+            return;
+        }
+        int mask = event_mask(ar->event);
+        for(std::size_t i = 0; i < self->entries.size(); ++i) {
+            if((self->entries[i].mask & mask) != 0) {
+                self->entries[i].fx(L, ar, self->entries[i].data);
+            }
+        }
+    }
+
+public:
+    static hook_dispatcher& get(lua_State* L) {
+        hook_dispatcher* self = find(L);
+        if(self == nullptr) {
+            void* memory = lua_newuserdata(L, sizeof(hook_dispatcher));
+            self = new (memory) hook_dispatcher();
+            lua_createtable(L, 0, 1);
+            lua_pushcfunction(L, &destroy);
+            lua_setfield(L, -2, "__gc");
+            lua_setmetatable(L, -2);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, hook_dispatcher_key());
+        }
+        return *self;
+    }
+
+    int add(lua_State* L, int mask, int hook_count, hook_function fx, void* data) {
+        if((mask & LUA_MASKCOUNT) != 0 && hook_count <= 0) {
+            throw error("count hooks need a count above zero");
+        }
+        hook_entry e = { next_id++, mask, hook_count, hook_count, fx, data };
+        entries.push_back(e);
+        install(L);
+        return e.id;
+    }
+
+    void remove(lua_State* L, int id) {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [id] (const hook_entry& e) {
+            return e.id == id;
+        }), entries.end());
+        install(L);
+    }
+
+    // changes how often a count hook runs, takes effect from its next call
+    void set_count(lua_State* L, int id, int hook_count) {
+        for(auto&& e : entries) {
+            if(e.id == id) {
+                e.count = hook_count;
+                e.remaining = std::min(e.remaining, hook_count);
+            }
+        }
+        install(L);
+    }
+
+    void install(lua_State* L) {
+        int mask = 0;
+        count = 0;
+        for(auto&& e : entries) {
+            mask |= e.mask;
+            if((e.mask & LUA_MASKCOUNT) != 0) {
+                count = count == 0 ? e.count : std::min(count, e.count);
+            }
+        }
+        lua_sethook(L, mask != 0 ? &dispatch : nullptr, mask, count);
+    }
+};
+} // detail
+
+// Adds a hook for the events in mask, count hooks run every count instructions.
+// Any number of hooks can be added to one state. They are set on the given thread,
+// coroutines created afterwards inherit them. Returns an id for remove_hook.
+inline int add_hook(lua_State* L, int mask, int count, hook_function fx, void* data = nullptr) {
+    return detail::hook_dispatcher::get(L).add(L, mask, count, fx, data);
+}
+
+inline void remove_hook(lua_State* L, int id) {
+    detail::hook_dispatcher::get(L).remove(L, id);
+}
+
+inline void set_hook_count(lua_State* L, int id, int count) {
+    detail::hook_dispatcher::get(L).set_count(L, id, count);
+}
+} // sol
+
+#endif // SOL_HOOK_HPP
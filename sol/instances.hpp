@@ -0,0 +1,177 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_INSTANCES_HPP
+#define SOL_INSTANCES_HPP
+
+#include "userdata_traits.hpp"
+#include "external_memory.hpp"
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sol {
+struct instance_count {
+    std::size_t live;
+    std::size_t peak;
+    std::size_t bytes;
+};
+
+namespace detail {
+const char instances_key[] = "sol.instances";
+
+// one plain userdata per type and state, kept in the registry under the address of
+// the type's metatable name and listed by type name in the sol.instances table
+struct instance_counter {
+    instance_count count;
+    const std::string* name;
+};
+
+template<typename T>
+inline instance_counter* find_instance_counter(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &userdata_traits<T>::metatable);
+    void* counter = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return static_cast<instance_counter*>(counter);
+}
+
+template<typename T>
+inline instance_counter& instance_counter_of(lua_State* L) {
+    instance_counter* counter = find_instance_counter<T>(L);
+    if(counter != nullptr) {
+        return *counter;
+    }
+    counter = static_cast<instance_counter*>(lua_newuserdata(L, sizeof(instance_counter)));
+    counter->count = instance_count{ 0, 0, 0 };
+    counter->name = &userdata_traits<T>::name;
+    lua_getfield(L, LUA_REGISTRYINDEX, instances_key);
+    if(lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 8);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, instances_key);
+    }
+    lua_pushvalue(L, -2);
+    lua_setfield(L, -2, userdata_traits<T>::name.c_str());
+    lua_pop(L, 1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &userdata_traits<T>::metatable);
+    return *counter;
+}
+
+// userdata_created is called for every T owned by the state once its metatable is set
+// and userdata_destroyed from its __gc
+template<typename T>
+inline void userdata_created(lua_State* L, const T& obj) {
+    std::size_t external = external_memory_traits<T>::size(obj);
+    instance_count& count = instance_counter_of<T>(L).count;
+    ++count.live;
+    count.bytes += sizeof(T) + external;
+    if(count.live > count.peak) {
+        count.peak = count.live;
+    }
+    add_external_memory(L, external);
+}
+
+template<typename T>
+inline void userdata_destroyed(lua_State* L, const T& obj) {
+    std::size_t external = external_memory_traits<T>::size(obj);
+    instance_counter* counter = find_instance_counter<T>(L);
+    if(counter != nullptr && counter->count.live != 0) {
+        --counter->count.live;
+        counter->count.bytes -= sizeof(T) + external;
+    }
+    remove_external_memory(L, external);
+}
+
+inline void push_instance_count(lua_State* L, const instance_count& count) {
+    lua_createtable(L, 0, 3);
+    lua_pushunsigned(L, static_cast<lua_Unsigned>(count.live));
+    lua_setfield(L, -2, "live");
+    lua_pushunsigned(L, static_cast<lua_Unsigned>(count.peak));
+    lua_setfield(L, -2, "peak");
+    lua_pushnumber(L, static_cast<lua_Number>(count.bytes));
+    lua_setfield(L, -2, "bytes");
+}
+
+inline int instances_function(lua_State* L) {
+    lua_newtable(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, instances_key);
+    if(lua_istable(L, -1)) {
+        lua_pushnil(L);
+        while(lua_next(L, -2) != 0) {
+            lua_pushvalue(L, -2);
+            push_instance_count(L, static_cast<instance_counter*>(lua_touserdata(L, -2))->count);
+            lua_settable(L, -6);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    return 1;
+}
+} // detail
+
+// Live, peak and byte counts of the userdata of type T held by a state. Bytes are the
+// size of T plus what external_memory_traits<T> reports. Objects pushed by pointer are
+// not owned by the state and are not counted.
+template<typename T>
+inline instance_count instances(lua_State* L) {
+    detail::instance_counter* counter = detail::find_instance_counter<T>(L);
+    return counter == nullptr ? instance_count{ 0, 0, 0 } : counter->count;
+}
+
+// every type that has had an instance in the state, by type name
+inline std::vector<std::pair<std::string, instance_count>> instances(lua_State* L) {
+    std::vector<std::pair<std::string, instance_count>> result;
+    lua_getfield(L, LUA_REGISTRYINDEX, detail::instances_key);
+    if(lua_istable(L, -1)) {
+        lua_pushnil(L);
+        while(lua_next(L, -2) != 0) {
+            detail::instance_counter* counter = static_cast<detail::instance_counter*>(lua_touserdata(L, -1));
+            result.emplace_back(*counter->name, counter->count);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    return result;
+}
+
+template<typename T>
+inline void reset_instance_peak(lua_State* L) {
+    detail::instance_counter* counter = detail::find_instance_counter<T>(L);
+    if(counter != nullptr) {
+        counter->count.peak = counter->count.live;
+    }
+}
+
+// The instances Lua module, a table with counts() returning { [type name] = { live =, peak =, bytes = } }.
+// Load it with e.g. luaL_requiref(L, "instances", &sol::open_instances, 0).
+inline int open_instances(lua_State* L) {
+    const luaL_Reg functions[] = {
+        { "counts", &detail::instances_function },
+        { nullptr, nullptr }
+    };
+    luaL_newlib(L, functions);
+    return 1;
+}
+} // sol
+
+#endif // SOL_INSTANCES_HPP
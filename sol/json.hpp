@@ -0,0 +1,584 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_JSON_HPP
+#define SOL_JSON_HPP
+
+#include "object.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace sol {
+namespace detail {
+const int json_max_depth = 200;
+
+// Values of an array or object are parsed onto the stack first and moved into a table
+// once the closing bracket is seen, so the table can be created at its final size.
+// Very long arrays and objects are flushed in batches to bound stack use.
+const int json_batch = 256;
+
+class json_reader {
+private:
+    lua_State* L;
+    const char* begin;
+    const char* pos;
+    const char* end;
+
+    [[noreturn]] void fail(const char* what) const {
+        throw error("invalid JSON at offset " + std::to_string(pos - begin) + ": " + what);
+    }
+
+    void skip_space() {
+        while(pos != end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) {
+            ++pos;
+        }
+    }
+
+    bool consume(char c) {
+        skip_space();
+        if(pos != end && *pos == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect_literal(const char* literal, std::size_t size) {
+        if(static_cast<std::size_t>(end - pos) < size || std::char_traits<char>::compare(pos, literal, size) != 0) {
+            fail("unexpected character");
+        }
+        pos += size;
+    }
+
+    static int hex(char c) {
+        if(c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if(c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if(c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    unsigned get_hex4() {
+        if(end - pos < 4) {
+            fail("truncated unicode escape");
+        }
+        unsigned value = 0;
+        for(int i = 0; i < 4; ++i) {
+            int digit = hex(*pos++);
+            if(digit < 0) {
+                fail("invalid unicode escape");
+            }
+            value = (value << 4) | static_cast<unsigned>(digit);
+        }
+        return value;
+    }
+
+    static void add_utf8(luaL_Buffer& buffer, unsigned cp) {
+        if(cp < 0x80) {
+            luaL_addchar(&buffer, static_cast<char>(cp));
+        }
+        else if(cp < 0x800) {
+            luaL_addchar(&buffer, static_cast<char>(0xc0 | (cp >> 6)));
+            luaL_addchar(&buffer, static_cast<char>(0x80 | (cp & 0x3f)));
+        }
+        else if(cp < 0x10000) {
+            luaL_addchar(&buffer, static_cast<char>(0xe0 | (cp >> 12)));
+            luaL_addchar(&buffer, static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+            luaL_addchar(&buffer, static_cast<char>(0x80 | (cp & 0x3f)));
+        }
+        else {
+            luaL_addchar(&buffer, static_cast<char>(0xf0 | (cp >> 18)));
+            luaL_addchar(&buffer, static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+            luaL_addchar(&buffer, static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+            luaL_addchar(&buffer, static_cast<char>(0x80 | (cp & 0x3f)));
+        }
+    }
+
+    // strings without escapes are pushed straight from the input
+    void push_string() {
+        ++pos;
+        const char* start = pos;
+        while(pos != end && *pos != '"' && *pos != '\\') {
+            if(static_cast<unsigned char>(*pos) < 0x20) {
+                fail("control character in string");
+            }
+            ++pos;
+        }
+        if(pos == end) {
+            fail("unterminated string");
+        }
+        if(*pos == '"') {
+            lua_pushlstring(L, start, static_cast<std::size_t>(pos - start));
+            ++pos;
+            return;
+        }
+
+        luaL_Buffer buffer;
+        luaL_buffinit(L, &buffer);
+        luaL_addlstring(&buffer, start, static_cast<std::size_t>(pos - start));
+        while(true) {
+            if(pos == end) {
+                fail("unterminated string");
+            }
+            char c = *pos++;
+            if(c == '"') {
+                break;
+            }
+            if(static_cast<unsigned char>(c) < 0x20) {
+                fail("control character in string");
+            }
+            if(c != '\\') {
+                luaL_addchar(&buffer, c);
+                continue;
+            }
+            if(pos == end) {
+                fail("unterminated string");
+            }
+            switch(*pos++) {
+            case '"': luaL_addchar(&buffer, '"'); break;
+            case '\\': luaL_addchar(&buffer, '\\'); break;
+            case '/': luaL_addchar(&buffer, '/'); break;
+            case 'b': luaL_addchar(&buffer, '\b'); break;
+            case 'f': luaL_addchar(&buffer, '\f'); break;
+            case 'n': luaL_addchar(&buffer, '\n'); break;
+            case 'r': luaL_addchar(&buffer, '\r'); break;
+            case 't': luaL_addchar(&buffer, '\t'); break;
+            case 'u': {
+                unsigned cp = get_hex4();
+                if(cp >= 0xd800 && cp <= 0xdbff) {
+                    if(end - pos < 2 || pos[0] != '\\' || pos[1] != 'u') {
+                        fail("unpaired surrogate");
+                    }
+                    pos += 2;
+                    unsigned low = get_hex4();
+                    if(low < 0xdc00 || low > 0xdfff) {
+                        fail("unpaired surrogate");
+                    }
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if(cp >= 0xdc00 && cp <= 0xdfff) {
+                    fail("unpaired surrogate");
+                }
+                add_utf8(buffer, cp);
+                break;
+            }
+            default:
+                fail("invalid escape");
+            }
+        }
+        luaL_pushresult(&buffer);
+    }
+
+    void skip_digits() {
+        while(pos != end && *pos >= '0' && *pos <= '9') {
+            ++pos;
+        }
+    }
+
+    void push_number() {
+        const char* start = pos;
+        if(pos != end && *pos == '-') {
+            ++pos;
+        }
+        if(pos == end || *pos < '0' || *pos > '9') {
+            fail("invalid number");
+        }
+        if(*pos == '0') {
+            ++pos;
+        }
+        else {
+            skip_digits();
+        }
+        if(pos != end && *pos == '.') {
+            ++pos;
+            if(pos == end || *pos < '0' || *pos > '9') {
+                fail("invalid number");
+            }
+            skip_digits();
+        }
+        if(pos != end && (*pos == 'e' || *pos == 'E')) {
+            ++pos;
+            if(pos != end && (*pos == '+' || *pos == '-')) {
+                ++pos;
+            }
+            if(pos == end || *pos < '0' || *pos > '9') {
+                fail("invalid number");
+            }
+            skip_digits();
+        }
+
+        // the input is not null terminated, strtod needs a copy
+        char digits[64];
+        std::size_t size = static_cast<std::size_t>(pos - start);
+        if(size < sizeof(digits)) {
+            std::char_traits<char>::copy(digits, start, size);
+            digits[size] = '\0';
+            lua_pushnumber(L, static_cast<lua_Number>(std::strtod(digits, nullptr)));
+        }
+        else {
+            lua_pushnumber(L, static_cast<lua_Number>(std::strtod(std::string(start, size).c_str(), nullptr)));
+        }
+    }
+
+    void push_array(int depth) {
+        ++pos;
+        int table = 0;
+        int pending = 0;
+        int count = 0;
+        auto flush = [&] (int narr) {
+            if(table == 0) {
+                lua_createtable(L, narr, 0);
+                lua_insert(L, -1 - pending);
+                table = lua_gettop(L) - pending;
+            }
+            for(int i = pending; i > 0; --i) {
+                lua_rawseti(L, table, count - pending + i);
+            }
+            pending = 0;
+        };
+
+        if(!consume(']')) {
+            do {
+                get_value(depth + 1);
+                ++pending;
+                ++count;
+                if(pending == json_batch) {
+                    flush(json_batch * 2);
+                }
+            }
+            while(consume(','));
+            if(!consume(']')) {
+                fail("expected ',' or ']'");
+            }
+        }
+        flush(pending);
+    }
+
+    void push_object(int depth) {
+        ++pos;
+        int table = 0;
+        int pending = 0;
+        auto flush = [&] (int nrec) {
+            if(table == 0) {
+                lua_createtable(L, 0, nrec);
+                lua_insert(L, -1 - pending * 2);
+                table = lua_gettop(L) - pending * 2;
+            }
+            // in input order, so that the last of repeated keys wins
+            if(!lua_checkstack(L, 2)) {
+                fail("object is too large");
+            }
+            for(int i = 0; i < pending; ++i) {
+                lua_pushvalue(L, table + 1 + i * 2);
+                lua_pushvalue(L, table + 2 + i * 2);
+                lua_rawset(L, table);
+            }
+            lua_settop(L, table);
+            pending = 0;
+        };
+
+        if(!consume('}')) {
+            do {
+                skip_space();
+                if(pos == end || *pos != '"') {
+                    fail("expected a string key");
+                }
+                if(!lua_checkstack(L, 2)) {
+                    fail("object is too large");
+                }
+                push_string();
+                if(!consume(':')) {
+                    fail("expected ':'");
+                }
+                get_value(depth + 1);
+                ++pending;
+                if(pending == json_batch) {
+                    flush(json_batch * 2);
+                }
+            }
+            while(consume(','));
+            if(!consume('}')) {
+                fail("expected ',' or '}'");
+            }
+        }
+        flush(pending);
+    }
+
+public:
+    json_reader(lua_State* L, const char* data, std::size_t size): L(L), begin(data), pos(data), end(data + size) {}
+
+    // null becomes nil, so it leaves a hole in arrays and drops the key from objects
+    void get_value(int depth = 0) {
+        if(depth > json_max_depth) {
+            fail("nested too deeply");
+        }
+        if(!lua_checkstack(L, 3)) {
+            fail("array is too large");
+        }
+        skip_space();
+        if(pos == end) {
+            fail("unexpected end of input");
+        }
+        switch(*pos) {
+        case '{':
+            push_object(depth);
+            break;
+        case '[':
+            push_array(depth);
+            break;
+        case '"':
+            push_string();
+            break;
+        case 't':
+            expect_literal("true", 4);
+            lua_pushboolean(L, 1);
+            break;
+        case 'f':
+            expect_literal("false", 5);
+            lua_pushboolean(L, 0);
+            break;
+        case 'n':
+            expect_literal("null", 4);
+            lua_pushnil(L);
+            break;
+        default:
+            push_number();
+            break;
+        }
+    }
+
+    void finish() {
+        skip_space();
+        if(pos != end) {
+            fail("trailing characters");
+        }
+    }
+};
+
+class json_writer {
+private:
+    lua_State* L;
+    std::string& out;
+
+    void put_number(lua_Number number) {
+        double d = static_cast<double>(number);
+        if(d != d || d - d != 0) {
+            throw error("cannot encode NaN or infinity as JSON");
+        }
+        char digits[32];
+        int size = d == std::floor(d) && std::fabs(d) < 1e15 ? std::snprintf(digits, sizeof(digits), "%.0f", d)
+                                                             : std::snprintf(digits, sizeof(digits), "%.17g", d);
+        out.append(digits, static_cast<std::size_t>(size));
+    }
+
+    void put_string(const char* str, std::size_t size) {
+        static const char digits[] = "0123456789abcdef";
+        out.push_back('"');
+        const char* run = str;
+        const char* stop = str + size;
+        for(const char* p = str; p != stop; ++p) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if(c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            out.append(run, p);
+            run = p + 1;
+            out.push_back('\\');
+            switch(c) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '\n': out.push_back('n'); break;
+            case '\r': out.push_back('r'); break;
+            case '\t': out.push_back('t'); break;
+            default:
+                out.append("u00");
+                out.push_back(digits[c >> 4]);
+                out.push_back(digits[c & 0xf]);
+                break;
+            }
+        }
+        out.append(run, stop);
+        out.push_back('"');
+    }
+
+    void put_key(int index) {
+        int t = lua_type(L, index);
+        if(t == LUA_TSTRING) {
+            std::size_t len;
+            const char* str = lua_tolstring(L, index, &len);
+            put_string(str, len);
+        }
+        else if(t == LUA_TNUMBER) {
+            out.push_back('"');
+            put_number(lua_tonumber(L, index));
+            out.push_back('"');
+        }
+        else {
+            throw error(std::string("cannot encode a key of type ") + lua_typename(L, t) + " as JSON");
+        }
+    }
+
+    // a table whose keys are exactly 1..n becomes an array, anything else an object
+    void put_table(int index, int depth) {
+        if(depth > json_max_depth) {
+            throw error("table is nested too deeply or refers to itself");
+        }
+        if(!lua_checkstack(L, 3)) {
+            throw error("not enough stack space to encode a table");
+        }
+        std::size_t n = lua_rawlen(L, index);
+        std::size_t count = 0;
+        bool sequence = true;
+        lua_pushnil(L);
+        while(lua_next(L, index) != 0) {
+            ++count;
+            if(sequence) {
+                lua_Number key = lua_type(L, -2) == LUA_TNUMBER ? lua_tonumber(L, -2) : 0;
+                sequence = key >= 1 && key <= static_cast<lua_Number>(n) && key == std::floor(key);
+            }
+            lua_pop(L, 1);
+        }
+
+        if(sequence && count == n && n > 0) {
+            out.push_back('[');
+            for(std::size_t i = 1; i <= n; ++i) {
+                if(i > 1) {
+                    out.push_back(',');
+                }
+                lua_rawgeti(L, index, static_cast<int>(i));
+                put_value(lua_gettop(L), depth + 1);
+                lua_pop(L, 1);
+            }
+            out.push_back(']');
+            return;
+        }
+
+        out.push_back('{');
+        bool first = true;
+        lua_pushnil(L);
+        while(lua_next(L, index) != 0) {
+            if(!first) {
+                out.push_back(',');
+            }
+            first = false;
+            int top = lua_gettop(L);
+            put_key(top - 1);
+            out.push_back(':');
+            put_value(top, depth + 1);
+            lua_pop(L, 1);
+        }
+        out.push_back('}');
+    }
+
+public:
+    json_writer(lua_State* L, std::string& out): L(L), out(out) {}
+
+    void put_value(int index, int depth = 0) {
+        int t = lua_type(L, index);
+        switch(t) {
+        case LUA_TNIL:
+            out.append("null");
+            break;
+        case LUA_TBOOLEAN:
+            out.append(lua_toboolean(L, index) ? "true" : "false");
+            break;
+        case LUA_TNUMBER:
+            put_number(lua_tonumber(L, index));
+            break;
+        case LUA_TSTRING: {
+            std::size_t len;
+            const char* str = lua_tolstring(L, index, &len);
+            put_string(str, len);
+            break;
+        }
+        case LUA_TTABLE:
+            put_table(index, depth);
+            break;
+        default:
+            throw error(std::string("cannot encode a value of type ") + lua_typename(L, t) + " as JSON");
+        }
+    }
+};
+} // detail
+
+// pushes the JSON value in data, which must hold exactly one value
+inline void json_decode(lua_State* L, const char* data, std::size_t size) {
+    int top = lua_gettop(L);
+    try {
+        detail::json_reader reader(L, data, size);
+        reader.get_value();
+        reader.finish();
+    }
+    catch(...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+inline object json_decode(lua_State* L, const std::string& data) {
+    json_decode(L, data.data(), data.size());
+    object result(L);
+    lua_pop(L, 1);
+    return result;
+}
+
+// Appends the value at index to out as JSON. Tables with keys 1..n are written as
+// arrays and other tables as objects, with number keys written as strings.
+inline void json_encode(lua_State* L, int index, std::string& out) {
+    index = lua_absindex(L, index);
+    int top = lua_gettop(L);
+    std::size_t size = out.size();
+    try {
+        detail::json_writer writer(L, out);
+        writer.put_value(index);
+    }
+    catch(...) {
+        lua_settop(L, top);
+        out.resize(size);
+        throw;
+    }
+}
+
+inline std::string json_encode(const reference& value) {
+    std::string out;
+    lua_State* L = value.state();
+    value.push();
+    try {
+        json_encode(L, -1, out);
+    }
+    catch(...) {
+        lua_pop(L, 1);
+        throw;
+    }
+    lua_pop(L, 1);
+    return out;
+}
+} // sol
+
+#endif // SOL_JSON_HPP
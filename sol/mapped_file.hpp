@@ -0,0 +1,135 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_MAPPED_FILE_HPP
+#define SOL_MAPPED_FILE_HPP
+
+#include "error.hpp"
+#include <string>
+#include <cstddef>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#include <vector>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace sol {
+namespace detail {
+// read-only view of a whole file, memory mapped where the platform allows it
+class mapped_file {
+private:
+    const char* address = nullptr;
+    std::size_t length = 0;
+#ifdef _WIN32
+    std::vector<char> buffer;
+#endif // _WIN32
+
+    void release() noexcept {
+#ifndef _WIN32
+        if(address != nullptr && length != 0) {
+            munmap(const_cast<char*>(address), length);
+        }
+#endif // _WIN32
+        address = nullptr;
+        length = 0;
+    }
+public:
+    mapped_file() noexcept = default;
+
+    explicit mapped_file(const std::string& filename) {
+#ifdef _WIN32
+        std::ifstream file(filename, std::ios::in | std::ios::binary);
+        if(!file) {
+            throw error("unable to open file: " + filename);
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        address = buffer.data();
+        length = buffer.size();
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd == -1) {
+            throw error("unable to open file: " + filename);
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) == -1) {
+            close(fd);
+            throw error("unable to stat file: " + filename);
+        }
+
+        length = static_cast<std::size_t>(info.st_size);
+        if(length == 0) {
+            close(fd);
+            return;
+        }
+
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapping == MAP_FAILED) {
+            length = 0;
+            throw error("unable to map file: " + filename);
+        }
+        address = static_cast<const char*>(mapping);
+#endif // _WIN32
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& o) noexcept {
+        *this = std::move(o);
+    }
+
+    mapped_file& operator=(mapped_file&& o) noexcept {
+        release();
+#ifdef _WIN32
+        buffer = std::move(o.buffer);
+#endif // _WIN32
+        address = o.address;
+        length = o.length;
+        o.address = nullptr;
+        o.length = 0;
+        return *this;
+    }
+
+    ~mapped_file() {
+        release();
+    }
+
+    const char* data() const noexcept {
+        return address;
+    }
+
+    std::size_t size() const noexcept {
+        return length;
+    }
+};
+} // detail
+} // sol
+
+#endif // SOL_MAPPED_FILE_HPP
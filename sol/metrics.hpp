@@ -0,0 +1,266 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_METRICS_HPP
+#define SOL_METRICS_HPP
+
+#include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sol {
+// Call metrics policies for C++ functions bound to Lua. A policy reserves upvalues
+// when a function is pushed, attaches the registered name to them once it is known
+// and measures each call through a scope object. no_metrics does none of this and
+// is the default, defining SOL_CALL_METRICS switches every binding to call_metrics.
+struct no_metrics {
+    struct scope {
+        scope(lua_State*, int) noexcept {}
+    };
+
+    static int reserve(lua_State*) noexcept {
+        return 0;
+    }
+
+    static void attach(lua_State*, int, const std::string&) noexcept {}
+};
+
+struct call_report {
+    static const int buckets = 40;
+
+    std::string name;
+    std::uint64_t calls = 0;
+    std::uint64_t errors = 0;
+    std::chrono::nanoseconds total{ 0 };
+    // calls that took [2^i, 2^(i+1)) nanoseconds
+    std::array<std::uint64_t, buckets> histogram{ {} };
+
+    std::chrono::nanoseconds mean() const {
+        return calls == 0 ? std::chrono::nanoseconds(0) : total / static_cast<std::int64_t>(calls);
+    }
+
+    // upper bound of the bucket holding the given fraction of calls, e.g. 0.99
+    std::chrono::nanoseconds percentile(double fraction) const {
+        std::uint64_t target = static_cast<std::uint64_t>(fraction * static_cast<double>(calls));
+        std::uint64_t seen = 0;
+        for(int i = 0; i < buckets; ++i) {
+            seen += histogram[i];
+            if(seen > target || seen == calls) {
+                return std::chrono::nanoseconds(std::int64_t(1) << (i + 1));
+            }
+        }
+        return std::chrono::nanoseconds(0);
+    }
+};
+
+namespace detail {
+// Counters are split into shards and every thread sticks to one of them, so threads
+// rarely write to the same cache lines and reads merge the shards without locking.
+// A shard spans several cache lines, only its edges can be shared with a neighbour.
+const int metric_shards = 16;
+
+struct metric_shard {
+    std::atomic<std::uint64_t> calls;
+    std::atomic<std::uint64_t> errors;
+    std::atomic<std::uint64_t> nanoseconds;
+    std::array<std::atomic<std::uint64_t>, call_report::buckets> histogram;
+};
+
+inline int metric_shard_index() {
+    static std::atomic<int> next(0);
+    static thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % metric_shards;
+    return index;
+}
+
+struct metric_entry {
+    std::string name;
+    std::array<metric_shard, metric_shards> shards;
+
+    explicit metric_entry(std::string name): name(std::move(name)) {
+        reset();
+    }
+
+    void record(std::uint64_t ns, bool failed) noexcept {
+        metric_shard& s = shards[metric_shard_index()];
+        s.calls.fetch_add(1, std::memory_order_relaxed);
+        s.nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+        if(failed) {
+            s.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        int bucket = 0;
+        while(ns > 1 && bucket < call_report::buckets - 1) {
+            ns >>= 1;
+            ++bucket;
+        }
+        s.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    call_report report() const {
+        call_report r;
+        r.name = name;
+        std::uint64_t ns = 0;
+        for(auto&& s : shards) {
+            r.calls += s.calls.load(std::memory_order_relaxed);
+            r.errors += s.errors.load(std::memory_order_relaxed);
+            ns += s.nanoseconds.load(std::memory_order_relaxed);
+            for(int i = 0; i < call_report::buckets; ++i) {
+                r.histogram[i] += s.histogram[i].load(std::memory_order_relaxed);
+            }
+        }
+        r.total = std::chrono::nanoseconds(ns);
+        return r;
+    }
+
+    void reset() noexcept {
+        for(auto&& s : shards) {
+            s.calls.store(0, std::memory_order_relaxed);
+            s.errors.store(0, std::memory_order_relaxed);
+            s.nanoseconds.store(0, std::memory_order_relaxed);
+            for(auto&& h : s.histogram) {
+                h.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// entries are never removed, so the pointers held by closures stay valid
+class metric_registry {
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<metric_entry>> entries;
+
+public:
+    metric_entry* entry(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<metric_entry>& e = entries[name];
+        if(!e) {
+            e.reset(new metric_entry(name));
+        }
+        return e.get();
+    }
+
+    std::vector<call_report> report() {
+        std::vector<call_report> result;
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto&& e : entries) {
+            result.push_back(e.second->report());
+        }
+        return result;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto&& e : entries) {
+            e.second->reset();
+        }
+    }
+};
+
+inline metric_registry& metrics() {
+    static metric_registry registry;
+    return registry;
+}
+} // detail
+
+struct call_metrics {
+    // times a call and counts it as an error if it leaves through an exception
+    class scope {
+    private:
+        detail::metric_entry* entry;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        scope(lua_State* L, int upvalue) noexcept: entry(static_cast<detail::metric_entry*>(lua_touserdata(L, lua_upvalueindex(upvalue)))) {
+            if(entry != nullptr) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~scope() {
+            if(entry != nullptr) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+                entry->record(static_cast<std::uint64_t>(elapsed.count()), std::uncaught_exception());
+            }
+        }
+    };
+
+    // the entry goes in the last upvalue, it stays empty until attach names it
+    static int reserve(lua_State* L) {
+        lua_pushlightuserdata(L, nullptr);
+        return 1;
+    }
+
+    // names the function at index, unless it has no empty slot left by reserve
+    static void attach(lua_State* L, int index, const std::string& name) {
+        index = lua_absindex(L, index);
+        int last = 0;
+        while(lua_getupvalue(L, index, last + 1) != nullptr) {
+            lua_pop(L, 1);
+            ++last;
+        }
+        if(last == 0) {
+            return;
+        }
+        lua_getupvalue(L, index, last);
+        bool reserved = lua_islightuserdata(L, -1) && lua_touserdata(L, -1) == nullptr;
+        lua_pop(L, 1);
+        if(reserved) {
+            lua_pushlightuserdata(L, detail::metrics().entry(name));
+            lua_setupvalue(L, index, last);
+        }
+    }
+
+    // every named binding called so far, the most expensive in total first
+    static std::vector<call_report> report() {
+        std::vector<call_report> result = detail::metrics().report();
+        result.erase(std::remove_if(result.begin(), result.end(), [] (const call_report& r) {
+            return r.calls == 0;
+        }), result.end());
+        std::sort(result.begin(), result.end(), [] (const call_report& l, const call_report& r) {
+            return l.total > r.total;
+        });
+        return result;
+    }
+
+    static void reset() {
+        detail::metrics().reset();
+    }
+};
+
+namespace detail {
+#ifdef SOL_CALL_METRICS
+typedef call_metrics default_metrics;
+#else
+typedef no_metrics default_metrics;
+#endif
+} // detail
+} // sol
+
+#endif // SOL_METRICS_HPP
@@ -0,0 +1,480 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_MSGPACK_HPP
+#define SOL_MSGPACK_HPP
+
+#include "object.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace sol {
+namespace detail {
+const int msgpack_max_depth = 200;
+
+class msgpack_writer {
+private:
+    lua_State* L;
+    std::string& out;
+
+    void put(unsigned char byte) {
+        out.push_back(static_cast<char>(byte));
+    }
+
+    // big endian, as MessagePack requires
+    void put(unsigned char type, std::uint64_t value, int bytes) {
+        put(type);
+        for(int i = bytes - 1; i >= 0; --i) {
+            put(static_cast<unsigned char>(value >> (i * 8)));
+        }
+    }
+
+    void put_size(std::size_t size, unsigned char fix, unsigned char fixmax, unsigned char base) {
+        if(size <= fixmax) {
+            put(static_cast<unsigned char>(fix | size));
+        }
+        else if(size <= 0xffff) {
+            put(base, size, 2);
+        }
+        else if(size <= 0xffffffff) {
+            put(static_cast<unsigned char>(base + 1), size, 4);
+        }
+        else {
+            throw error("value is too large for MessagePack");
+        }
+    }
+
+    void put_number(lua_Number number) {
+        double d = static_cast<double>(number);
+        if(d != std::floor(d) || d < -9223372036854775808.0 || d >= 18446744073709551616.0) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+            put(0xcb, bits, 8);
+        }
+        else if(d >= 0) {
+            std::uint64_t u = static_cast<std::uint64_t>(d);
+            if(u < 0x80) {
+                put(static_cast<unsigned char>(u));
+            }
+            else if(u <= 0xff) {
+                put(0xcc, u, 1);
+            }
+            else if(u <= 0xffff) {
+                put(0xcd, u, 2);
+            }
+            else if(u <= 0xffffffff) {
+                put(0xce, u, 4);
+            }
+            else {
+                put(0xcf, u, 8);
+            }
+        }
+        else {
+            std::int64_t i = static_cast<std::int64_t>(d);
+            std::uint64_t u = static_cast<std::uint64_t>(i);
+            if(i >= -32) {
+                put(static_cast<unsigned char>(u));
+            }
+            else if(i >= -128) {
+                put(0xd0, u, 1);
+            }
+            else if(i >= -32768) {
+                put(0xd1, u, 2);
+            }
+            else if(i >= -2147483647 - 1) {
+                put(0xd2, u, 4);
+            }
+            else {
+                put(0xd3, u, 8);
+            }
+        }
+    }
+
+    void put_string(int index) {
+        std::size_t len;
+        const char* str = lua_tolstring(L, index, &len);
+        if(len <= 31) {
+            put(static_cast<unsigned char>(0xa0 | len));
+        }
+        else if(len <= 0xff) {
+            put(0xd9, len, 1);
+        }
+        else {
+            put_size(len, 0, 0, 0xda);
+        }
+        out.append(str, len);
+    }
+
+    // a table whose keys are exactly 1..n becomes an array, anything else a map
+    void put_table(int index, int depth) {
+        if(depth > msgpack_max_depth) {
+            throw error("table is nested too deeply or refers to itself");
+        }
+        if(!lua_checkstack(L, 3)) {
+            throw error("not enough stack space to encode a table");
+        }
+        std::size_t n = lua_rawlen(L, index);
+        std::size_t count = 0;
+        bool sequence = true;
+        lua_pushnil(L);
+        while(lua_next(L, index) != 0) {
+            ++count;
+            if(sequence) {
+                lua_Number key = lua_type(L, -2) == LUA_TNUMBER ? lua_tonumber(L, -2) : 0;
+                sequence = key >= 1 && key <= static_cast<lua_Number>(n) && key == std::floor(key);
+            }
+            lua_pop(L, 1);
+        }
+
+        if(sequence && count == n && n > 0) {
+            put_size(n, 0x90, 15, 0xdc);
+            for(std::size_t i = 1; i <= n; ++i) {
+                lua_rawgeti(L, index, static_cast<int>(i));
+                put_value(lua_gettop(L), depth + 1);
+                lua_pop(L, 1);
+            }
+            return;
+        }
+
+        put_size(count, 0x80, 15, 0xde);
+        lua_pushnil(L);
+        while(lua_next(L, index) != 0) {
+            int top = lua_gettop(L);
+            put_value(top - 1, depth + 1);
+            put_value(top, depth + 1);
+            lua_pop(L, 1);
+        }
+    }
+
+public:
+    msgpack_writer(lua_State* L, std::string& out): L(L), out(out) {}
+
+    void put_value(int index, int depth = 0) {
+        int t = lua_type(L, index);
+        switch(t) {
+        case LUA_TNIL:
+            put(0xc0);
+            break;
+        case LUA_TBOOLEAN:
+            put(lua_toboolean(L, index) ? 0xc3 : 0xc2);
+            break;
+        case LUA_TNUMBER:
+            put_number(lua_tonumber(L, index));
+            break;
+        case LUA_TSTRING:
+            put_string(index);
+            break;
+        case LUA_TTABLE:
+            put_table(index, depth);
+            break;
+        default:
+            throw error(std::string("cannot encode a value of type ") + lua_typename(L, t) + " as MessagePack");
+        }
+    }
+};
+
+class msgpack_reader {
+private:
+    lua_State* L;
+    const char* pos;
+    const char* end;
+
+    const char* take(std::size_t size) {
+        if(static_cast<std::size_t>(end - pos) < size) {
+            throw error("MessagePack data is truncated");
+        }
+        const char* result = pos;
+        pos += size;
+        return result;
+    }
+
+    std::uint64_t get(int bytes) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(take(bytes));
+        std::uint64_t value = 0;
+        for(int i = 0; i < bytes; ++i) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    std::int64_t get_signed(int bytes) {
+        std::uint64_t value = get(bytes);
+        int shift = 64 - bytes * 8;
+        return static_cast<std::int64_t>(value << shift) >> shift;
+    }
+
+    void push_string(std::size_t size) {
+        lua_pushlstring(L, take(size), size);
+    }
+
+    void push_array(std::size_t size, int depth) {
+        if(size > static_cast<std::size_t>(end - pos)) {
+            throw error("MessagePack array is larger than the data");
+        }
+        lua_createtable(L, static_cast<int>(size), 0);
+        for(std::size_t i = 1; i <= size; ++i) {
+            get_value(depth + 1);
+            lua_rawseti(L, -2, static_cast<int>(i));
+        }
+    }
+
+    void push_map(std::size_t size, int depth) {
+        if(size > static_cast<std::size_t>(end - pos) / 2) {
+            throw error("MessagePack map is larger than the data");
+        }
+        lua_createtable(L, 0, static_cast<int>(size));
+        for(std::size_t i = 0; i < size; ++i) {
+            get_value(depth + 1);
+            if(lua_isnil(L, -1) || lua_tonumber(L, -1) != lua_tonumber(L, -1)) {
+                throw error("MessagePack map has a nil or NaN key");
+            }
+            get_value(depth + 1);
+            lua_rawset(L, -3);
+        }
+    }
+
+public:
+    msgpack_reader(lua_State* L, const char* data, std::size_t size): L(L), pos(data), end(data + size) {}
+
+    std::size_t offset(const char* data) const {
+        return static_cast<std::size_t>(pos - data);
+    }
+
+    void get_value(int depth = 0) {
+        if(depth > msgpack_max_depth) {
+            throw error("MessagePack data is nested too deeply");
+        }
+        if(!lua_checkstack(L, 3)) {
+            throw error("not enough stack space to decode MessagePack");
+        }
+        unsigned char type = static_cast<unsigned char>(*take(1));
+        if(type < 0x80) {
+            lua_pushnumber(L, type);
+            return;
+        }
+        if(type >= 0xe0) {
+            lua_pushnumber(L, static_cast<signed char>(type));
+            return;
+        }
+        if((type & 0xe0) == 0xa0) {
+            push_string(type & 0x1f);
+            return;
+        }
+        if((type & 0xf0) == 0x90) {
+            push_array(type & 0x0f, depth);
+            return;
+        }
+        if((type & 0xf0) == 0x80) {
+            push_map(type & 0x0f, depth);
+            return;
+        }
+
+        switch(type) {
+        case 0xc0:
+            lua_pushnil(L);
+            break;
+        case 0xc2:
+            lua_pushboolean(L, 0);
+            break;
+        case 0xc3:
+            lua_pushboolean(L, 1);
+            break;
+        case 0xc4:
+        case 0xd9:
+            push_string(static_cast<std::size_t>(get(1)));
+            break;
+        case 0xc5:
+        case 0xda:
+            push_string(static_cast<std::size_t>(get(2)));
+            break;
+        case 0xc6:
+        case 0xdb:
+            push_string(static_cast<std::size_t>(get(4)));
+            break;
+        case 0xca: {
+            std::uint32_t bits = static_cast<std::uint32_t>(get(4));
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            lua_pushnumber(L, f);
+            break;
+        }
+        case 0xcb: {
+            std::uint64_t bits = get(8);
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            lua_pushnumber(L, static_cast<lua_Number>(d));
+            break;
+        }
+        case 0xcc:
+            lua_pushnumber(L, static_cast<lua_Number>(get(1)));
+            break;
+        case 0xcd:
+            lua_pushnumber(L, static_cast<lua_Number>(get(2)));
+            break;
+        case 0xce:
+            lua_pushnumber(L, static_cast<lua_Number>(get(4)));
+            break;
+        case 0xcf:
+            lua_pushnumber(L, static_cast<lua_Number>(get(8)));
+            break;
+        case 0xd0:
+            lua_pushnumber(L, static_cast<lua_Number>(get_signed(1)));
+            break;
+        case 0xd1:
+            lua_pushnumber(L, static_cast<lua_Number>(get_signed(2)));
+            break;
+        case 0xd2:
+            lua_pushnumber(L, static_cast<lua_Number>(get_signed(4)));
+            break;
+        case 0xd3:
+            lua_pushnumber(L, static_cast<lua_Number>(get_signed(8)));
+            break;
+        case 0xdc:
+            push_array(static_cast<std::size_t>(get(2)), depth);
+            break;
+        case 0xdd:
+            push_array(static_cast<std::size_t>(get(4)), depth);
+            break;
+        case 0xde:
+            push_map(static_cast<std::size_t>(get(2)), depth);
+            break;
+        case 0xdf:
+            push_map(static_cast<std::size_t>(get(4)), depth);
+            break;
+        default:
+            throw error("MessagePack extension types are not supported");
+        }
+    }
+};
+
+inline int msgpack_encode_function(lua_State* L);
+inline int msgpack_decode_function(lua_State* L);
+} // detail
+
+// Appends the value at index to out as MessagePack. Tables with keys 1..n are written as
+// arrays, other tables as maps, and integral numbers use the smallest integer encoding.
+// out is only appended to, so one buffer can be cleared and reused between calls.
+inline void msgpack_encode(lua_State* L, int index, std::string& out) {
+    index = lua_absindex(L, index);
+    int top = lua_gettop(L);
+    std::size_t size = out.size();
+    try {
+        detail::msgpack_writer writer(L, out);
+        writer.put_value(index);
+    }
+    catch(...) {
+        lua_settop(L, top);
+        out.resize(size);
+        throw;
+    }
+}
+
+inline void msgpack_encode(const reference& value, std::string& out) {
+    lua_State* L = value.state();
+    value.push();
+    try {
+        msgpack_encode(L, -1, out);
+    }
+    catch(...) {
+        lua_pop(L, 1);
+        throw;
+    }
+    lua_pop(L, 1);
+}
+
+// Pushes the first MessagePack value in data and returns how many bytes it took up.
+// Binary and string types both become Lua strings, and all integers become lua_Number.
+inline std::size_t msgpack_decode(lua_State* L, const char* data, std::size_t size) {
+    int top = lua_gettop(L);
+    detail::msgpack_reader reader(L, data, size);
+    try {
+        reader.get_value();
+    }
+    catch(...) {
+        lua_settop(L, top);
+        throw;
+    }
+    return reader.offset(data);
+}
+
+inline object msgpack_decode(lua_State* L, const std::string& data) {
+    msgpack_decode(L, data.data(), data.size());
+    object result(L);
+    lua_pop(L, 1);
+    return result;
+}
+
+// The msgpack Lua module, a table with encode(value) and decode(str [, pos]) where decode
+// returns the value and the position after it. Load it with e.g.
+// luaL_requiref(L, "msgpack", &sol::open_msgpack, 0).
+inline int open_msgpack(lua_State* L) {
+    const luaL_Reg functions[] = {
+        { "encode", &detail::msgpack_encode_function },
+        { "decode", &detail::msgpack_decode_function },
+        { nullptr, nullptr }
+    };
+    luaL_newlib(L, functions);
+    return 1;
+}
+
+namespace detail {
+// errors are turned into Lua errors once every C++ object in scope is gone,
+// since lua_error does not unwind the C++ stack
+inline int msgpack_encode_function(lua_State* L) {
+    luaL_checkany(L, 1);
+    lua_settop(L, 1);
+    {
+        std::string out;
+        try {
+            msgpack_encode(L, 1, out);
+            lua_pushlstring(L, out.data(), out.size());
+            return 1;
+        }
+        catch(const std::exception& e) {
+            lua_pushstring(L, e.what());
+        }
+    }
+    return lua_error(L);
+}
+
+inline int msgpack_decode_function(lua_State* L) {
+    std::size_t size;
+    const char* data = luaL_checklstring(L, 1, &size);
+    lua_Integer start = luaL_optinteger(L, 2, 1);
+    luaL_argcheck(L, start >= 1 && static_cast<std::size_t>(start) <= size + 1, 2, "position out of range");
+    std::size_t offset = static_cast<std::size_t>(start - 1);
+    try {
+        std::size_t used = msgpack_decode(L, data + offset, size - offset);
+        lua_pushinteger(L, static_cast<lua_Integer>(offset + used + 1));
+        return 2;
+    }
+    catch(const std::exception& e) {
+        lua_pushstring(L, e.what());
+    }
+    return lua_error(L);
+}
+} // detail
+} // sol
+
+#endif // SOL_MSGPACK_HPP
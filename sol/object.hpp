@@ -33,16 +33,20 @@ public:
 
     template<typename T>
     auto as() const -> decltype(stack::get<T>(state())) {
+        stack_guard guard(state());
         push();
         type_assert(state(), -1, type_of<T>());
-        return stack::get<T>(state());
+        // the value stays referenced by this object once popped
+        return stack::pop<T>(state());
     }
 
     template<typename T>
     bool is() const {
+        stack_guard guard(state());
         push();
         auto expected = type_of<T>();
         auto actual = lua_type(state(), -1);
+        lua_pop(state(), 1);
         return (static_cast<int>(expected) == actual) || (expected == type::poly);
     }
 
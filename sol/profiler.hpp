@@ -0,0 +1,292 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_PROFILER_HPP
+#define SOL_PROFILER_HPP
+
+#include "hook.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sol {
+// Samples the Lua call stack from a count hook and adds each sample to a call tree.
+// In count mode every sample is taken after a fixed number of instructions. In timer
+// mode a thread marks a sample as due once per period and the hook, checking every
+// few instructions, takes it. Stopped profilers remove their hook and cost nothing.
+// The tree holds at most max_nodes nodes, stacks that would need more are cut short.
+// Results should be read from the thread running the state or once stopped.
+class profiler {
+private:
+    struct frame_key {
+        const void* id;
+        int line;
+
+        bool operator==(const frame_key& o) const noexcept {
+            return id == o.id && line == o.line;
+        }
+    };
+
+    struct frame_hash {
+        std::size_t operator()(const frame_key& k) const noexcept {
+            return std::hash<const void*>()(k.id) ^ (static_cast<std::size_t>(k.line) * 2654435761u);
+        }
+    };
+
+    struct node {
+        std::uint32_t frame;
+        std::uint32_t parent;
+        std::size_t self;
+    };
+
+    static const int max_depth = 128;
+
+    lua_State* L;
+    std::size_t max_nodes;
+    std::vector<node> nodes;
+    std::vector<std::string> names;
+    std::unordered_map<frame_key, std::uint32_t, frame_hash> frames;
+    std::unordered_map<std::uint64_t, std::uint32_t> children;
+    std::size_t sampled = 0;
+    std::size_t truncated = 0;
+    std::size_t dropped = 0;
+    int hook = 0;
+
+    std::atomic<bool> due;
+    std::thread timer;
+    std::mutex timer_mutex;
+    std::condition_variable timer_wake;
+    bool timer_stopping = false;
+
+    // Lua functions are told apart by where they are defined, so every closure
+    // of one function shares a frame, and C functions by their address
+    std::uint32_t frame_of(lua_State* T, lua_Debug& ar) {
+        lua_getinfo(T, "Sn", &ar);
+        frame_key key = { ar.source, ar.linedefined };
+        if(std::strcmp(ar.what, "C") == 0) {
+            lua_getinfo(T, "f", &ar);
+            key.id = reinterpret_cast<const void*>(lua_tocfunction(T, -1));
+            lua_pop(T, 1);
+        }
+        auto it = frames.find(key);
+        if(it != frames.end()) {
+            return it->second;
+        }
+        if(names.size() >= max_nodes) {
+            return 0;
+        }
+
+        std::string name = ar.name != nullptr ? ar.name : (std::strcmp(ar.what, "main") == 0 ? "main chunk" : "?");
+        if(std::strcmp(ar.what, "C") == 0) {
+            name += " [C]";
+        }
+        else {
+            name += " (";
+            name += ar.short_src;
+            name += ':';
+            name += std::to_string(ar.linedefined);
+            name += ')';
+        }
+        std::uint32_t id = static_cast<std::uint32_t>(names.size());
+        names.push_back(std::move(name));
+        frames.emplace(key, id);
+        return id;
+    }
+
+    std::uint32_t child_of(std::uint32_t parent, std::uint32_t frame) {
+        std::uint64_t edge = (static_cast<std::uint64_t>(parent) << 32) | frame;
+        auto it = children.find(edge);
+        if(it != children.end()) {
+            return it->second;
+        }
+        if(nodes.size() >= max_nodes) {
+            return parent;
+        }
+        std::uint32_t id = static_cast<std::uint32_t>(nodes.size());
+        node n = { frame, parent, 0 };
+        nodes.push_back(n);
+        children.emplace(edge, id);
+        return id;
+    }
+
+    void sample(lua_State* T) {
+        std::uint32_t stack[max_depth];
+        int depth = 0;
+        lua_Debug ar;
+        for(int level = 0; depth < max_depth && lua_getstack(T, level, &ar) != 0; ++level) {
+            stack[depth++] = frame_of(T, ar);
+        }
+
+        std::uint32_t current = 0;
+        bool cut = depth == max_depth;
+        for(int i = depth - 1; i >= 0; --i) {
+            std::uint32_t next = child_of(current, stack[i]);
+            if(next == current) {
+                cut = true;
+                break;
+            }
+            current = next;
+        }
+        ++nodes[current].self;
+        ++sampled;
+        if(cut) {
+            ++truncated;
+        }
+    }
+
+    // hooks must not throw through Lua, a sample that cannot be stored is dropped
+    static void on_count(lua_State* T, lua_Debug*, void* data) {
+        profiler& self = *static_cast<profiler*>(data);
+        try {
+            self.sample(T);
+        }
+        catch(...) {
+            ++self.dropped;
+        }
+    }
+
+    static void on_timer_check(lua_State* T, lua_Debug* ar, void* data) {
+        profiler& self = *static_cast<profiler*>(data);
+        if(self.due.exchange(false, std::memory_order_relaxed)) {
+            on_count(T, ar, data);
+        }
+    }
+
+    void stop_timer() {
+        {
+            std::lock_guard<std::mutex> lock(timer_mutex);
+            if(!timer.joinable()) {
+                return;
+            }
+            timer_stopping = true;
+        }
+        timer_wake.notify_one();
+        timer.join();
+        timer = std::thread();
+    }
+
+public:
+    explicit profiler(lua_State* L, std::size_t max_nodes = 10000): L(L), max_nodes(max_nodes), due(false) {
+        clear();
+    }
+
+    profiler(const profiler&) = delete;
+    profiler& operator=(const profiler&) = delete;
+
+    ~profiler() {
+        stop();
+    }
+
+    // takes a sample every given number of instructions
+    void start(int instructions = 10000) {
+        stop();
+        hook = add_hook(L, LUA_MASKCOUNT, instructions, &on_count, this);
+    }
+
+    // takes a sample once per period of wall clock time, checking for a due sample
+    // every given number of instructions
+    template<typename Rep, typename Period>
+    void start_timer(std::chrono::duration<Rep, Period> period, int check = 1000) {
+        stop();
+        timer_stopping = false;
+        due.store(false, std::memory_order_relaxed);
+        timer = std::thread([this, period] {
+            std::unique_lock<std::mutex> lock(timer_mutex);
+            while(!timer_wake.wait_for(lock, period, [this] { return timer_stopping; })) {
+                due.store(true, std::memory_order_relaxed);
+            }
+        });
+        hook = add_hook(L, LUA_MASKCOUNT, check, &on_timer_check, this);
+    }
+
+    void stop() {
+        stop_timer();
+        if(hook != 0) {
+            remove_hook(L, hook);
+            hook = 0;
+        }
+    }
+
+    bool running() const noexcept {
+        return hook != 0;
+    }
+
+    void clear() {
+        nodes.assign(1, node{ 0, 0, 0 });
+        names.assign(1, "[other]");
+        frames.clear();
+        children.clear();
+        sampled = truncated = dropped = 0;
+    }
+
+    std::size_t samples() const noexcept {
+        return sampled;
+    }
+
+    // samples whose stack was cut short by max_depth or the node limit
+    std::size_t truncated_samples() const noexcept {
+        return truncated;
+    }
+
+    std::size_t dropped_samples() const noexcept {
+        return dropped;
+    }
+
+    std::size_t node_count() const noexcept {
+        return nodes.size();
+    }
+
+    // one "outer;inner;innermost count" line per stack, the input flamegraph.pl expects
+    std::string collapsed() const {
+        std::string out;
+        std::vector<std::uint32_t> path;
+        for(std::size_t i = 1; i < nodes.size(); ++i) {
+            if(nodes[i].self == 0) {
+                continue;
+            }
+            path.clear();
+            for(std::uint32_t n = static_cast<std::uint32_t>(i); n != 0; n = nodes[n].parent) {
+                path.push_back(nodes[n].frame);
+            }
+            for(auto it = path.rbegin(); it != path.rend(); ++it) {
+                if(it != path.rbegin()) {
+                    out += ';';
+                }
+                out += names[*it];
+            }
+            out += ' ';
+            out += std::to_string(nodes[i].self);
+            out += '\n';
+        }
+        return out;
+    }
+};
+} // sol
+
+#endif // SOL_PROFILER_HPP
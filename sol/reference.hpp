@@ -23,6 +23,7 @@
 #define SOL_REFERENCE_HPP
 
 #include "types.hpp"
+#include "stack_guard.hpp"
 
 namespace sol {
 class reference {
@@ -80,6 +81,7 @@ public:
     }
 
     type get_type() {
+        stack_guard guard(L);
         push();
         int result = lua_type(L, -1);
         lua_pop(L, 1);
@@ -0,0 +1,483 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_SNAPSHOT_HPP
+#define SOL_SNAPSHOT_HPP
+
+#include "object.hpp"
+#include "userdata_traits.hpp"
+#include "instances.hpp"
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace sol {
+// Saves and loads a userdata of type T in a snapshot. There is no default, types opt in
+// by specializing it and calling enable_snapshot<T> on the states involved:
+//     static void save(const T& value, std::string& out);
+//     static void load(const char* data, std::size_t size, void* memory);
+template<typename T>
+struct snapshot_traits;
+
+// Snapshot layout, in native byte order:
+// header  | magic "SOLS", version
+// root    | the saved value
+// records | the key/value pairs of every table, in the order the tables first appear
+//
+// Values are a one byte tag followed by their payload. A table or userdata gets an id the
+// first time it is written, the table along with its array and hash sizes, and is written
+// as a reference to that id afterwards, which keeps cycles and shared tables intact.
+// Tables are filled in from the records once everything they point to exists, so
+// neither saving nor loading recurses into nested tables.
+namespace detail {
+const char snapshot_magic[4] = { 'S', 'O', 'L', 'S' };
+const std::uint32_t snapshot_version = 1;
+const char snapshot_hook_key[] = "__snapshot";
+
+enum class snapshot_tag : unsigned char {
+    nil,
+    boolean_false,
+    boolean_true,
+    number,
+    string,
+    table,
+    userdata,
+    reference
+};
+
+struct snapshot_hook {
+    const std::string& (*name)();
+    void (*save)(lua_State* L, int index, std::string& out);
+    void (*load)(lua_State* L, const char* data, std::size_t size);
+};
+
+template<typename T>
+const std::string& snapshot_name() {
+    return userdata_traits<T>::metatable;
+}
+
+template<typename T>
+void snapshot_save(lua_State* L, int index, std::string& out) {
+    snapshot_traits<T>::save(*static_cast<T*>(lua_touserdata(L, index)), out);
+}
+
+template<typename T>
+void snapshot_load(lua_State* L, const char* data, std::size_t size) {
+    luaL_getmetatable(L, userdata_traits<T>::metatable.c_str());
+    void* memory = lua_newuserdata(L, sizeof(T));
+    snapshot_traits<T>::load(data, size, memory);
+    lua_insert(L, -2);
+    lua_setmetatable(L, -2);
+    userdata_created(L, *static_cast<T*>(memory));
+}
+
+template<typename T>
+struct snapshot_hook_for {
+    static const snapshot_hook value;
+};
+
+template<typename T>
+const snapshot_hook snapshot_hook_for<T>::value = { &snapshot_name<T>, &snapshot_save<T>, &snapshot_load<T> };
+
+inline const snapshot_hook* get_snapshot_hook(lua_State* L, int index) {
+    const snapshot_hook* hook = nullptr;
+    if(lua_getmetatable(L, index) != 0) {
+        lua_getfield(L, -1, snapshot_hook_key);
+        hook = static_cast<const snapshot_hook*>(lua_touserdata(L, -1));
+        lua_pop(L, 2);
+    }
+    return hook;
+}
+
+class snapshot_writer {
+private:
+    lua_State* L;
+    std::string& out;
+    int ids;
+    int queue;
+    int next_id = 0;
+    int head = 1;
+    int tail = 0;
+
+    template<typename T>
+    void put(const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put(snapshot_tag tag) {
+        out.push_back(static_cast<char>(tag));
+    }
+
+    void put_string(const char* str, std::size_t size) {
+        put(static_cast<std::uint32_t>(size));
+        out.append(str, size);
+    }
+
+    void patch(std::size_t offset, std::uint32_t value) {
+        std::memcpy(&out[offset], &value, sizeof(value));
+    }
+
+    // writes a back reference if the table or userdata was seen before, otherwise gives it an id
+    bool put_seen(int index) {
+        lua_pushlightuserdata(L, const_cast<void*>(lua_topointer(L, index)));
+        lua_rawget(L, ids);
+        if(!lua_isnil(L, -1)) {
+            put(snapshot_tag::reference);
+            put(static_cast<std::uint32_t>(lua_tointeger(L, -1)));
+            lua_pop(L, 1);
+            return true;
+        }
+        lua_pop(L, 1);
+        lua_pushlightuserdata(L, const_cast<void*>(lua_topointer(L, index)));
+        lua_pushinteger(L, next_id++);
+        lua_rawset(L, ids);
+        return false;
+    }
+
+    void put_table(int index) {
+        if(put_seen(index)) {
+            return;
+        }
+        std::uint32_t narr = static_cast<std::uint32_t>(lua_rawlen(L, index));
+        std::uint32_t total = 0;
+        lua_pushnil(L);
+        while(lua_next(L, index) != 0) {
+            ++total;
+            lua_pop(L, 1);
+        }
+        put(snapshot_tag::table);
+        put(narr);
+        put(total > narr ? total - narr : 0);
+
+        lua_pushvalue(L, index);
+        lua_rawseti(L, queue, ++tail);
+    }
+
+    void put_userdata(int index) {
+        const snapshot_hook* hook = get_snapshot_hook(L, index);
+        if(hook == nullptr) {
+            throw error("cannot snapshot userdata that has not enabled snapshots");
+        }
+        if(put_seen(index)) {
+            return;
+        }
+        const std::string& name = hook->name();
+        put(snapshot_tag::userdata);
+        put_string(name.data(), name.size());
+        std::size_t size_offset = out.size();
+        put(std::uint32_t(0));
+        hook->save(L, index, out);
+        patch(size_offset, static_cast<std::uint32_t>(out.size() - size_offset - sizeof(std::uint32_t)));
+    }
+
+public:
+    snapshot_writer(lua_State* L, std::string& out): L(L), out(out) {
+        if(!lua_checkstack(L, 8)) {
+            throw error("not enough stack space to write a snapshot");
+        }
+        lua_createtable(L, 0, 0);
+        ids = lua_gettop(L);
+        lua_createtable(L, 0, 0);
+        queue = lua_gettop(L);
+        out.append(snapshot_magic, sizeof(snapshot_magic));
+        put(snapshot_version);
+    }
+
+    void put_value(int index) {
+        int t = lua_type(L, index);
+        switch(t) {
+        case LUA_TNIL:
+            put(snapshot_tag::nil);
+            break;
+        case LUA_TBOOLEAN:
+            put(lua_toboolean(L, index) ? snapshot_tag::boolean_true : snapshot_tag::boolean_false);
+            break;
+        case LUA_TNUMBER:
+            put(snapshot_tag::number);
+            put(lua_tonumber(L, index));
+            break;
+        case LUA_TSTRING: {
+            std::size_t len;
+            const char* str = lua_tolstring(L, index, &len);
+            put(snapshot_tag::string);
+            put_string(str, len);
+            break;
+        }
+        case LUA_TTABLE:
+            put_table(index);
+            break;
+        case LUA_TUSERDATA:
+            put_userdata(index);
+            break;
+        default:
+            throw error(std::string("cannot snapshot a value of type ") + lua_typename(L, t));
+        }
+    }
+
+    void run() {
+        while(head <= tail) {
+            lua_rawgeti(L, queue, head++);
+            int source = lua_gettop(L);
+            std::size_t count_offset = out.size();
+            std::uint32_t count = 0;
+            put(count);
+            lua_pushnil(L);
+            while(lua_next(L, source) != 0) {
+                put_value(source + 1);
+                put_value(source + 2);
+                ++count;
+                lua_pop(L, 1);
+            }
+            patch(count_offset, count);
+            lua_pop(L, 1);
+        }
+    }
+};
+
+class snapshot_reader {
+private:
+    lua_State* L;
+    const char* pos;
+    const char* end;
+    int ids;
+    int next_id = 0;
+
+    const char* take(std::size_t size) {
+        if(static_cast<std::size_t>(end - pos) < size) {
+            throw error("snapshot is truncated");
+        }
+        const char* result = pos;
+        pos += size;
+        return result;
+    }
+
+    template<typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    void remember() {
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, ids, ++next_id);
+    }
+
+    void get_userdata() {
+        std::uint32_t name_size = get<std::uint32_t>();
+        std::string name(take(name_size), name_size);
+        std::uint32_t size = get<std::uint32_t>();
+        const char* data = take(size);
+
+        const snapshot_hook* hook = nullptr;
+        luaL_getmetatable(L, name.c_str());
+        if(lua_istable(L, -1)) {
+            lua_getfield(L, -1, snapshot_hook_key);
+            hook = static_cast<const snapshot_hook*>(lua_touserdata(L, -1));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+        if(hook == nullptr) {
+            throw error("snapshot contains userdata of type " + name + " which has not enabled snapshots");
+        }
+        hook->load(L, data, size);
+    }
+
+public:
+    snapshot_reader(lua_State* L, const char* data, std::size_t size): L(L), pos(data), end(data + size) {
+        if(!lua_checkstack(L, 8)) {
+            throw error("not enough stack space to read a snapshot");
+        }
+        if(std::memcmp(take(sizeof(snapshot_magic)), snapshot_magic, sizeof(snapshot_magic)) != 0) {
+            throw error("snapshot has an invalid signature");
+        }
+        if(get<std::uint32_t>() != snapshot_version) {
+            throw error("snapshot version is not supported");
+        }
+        lua_createtable(L, 0, 0);
+        ids = lua_gettop(L);
+    }
+
+    void get_value() {
+        switch(static_cast<snapshot_tag>(get<unsigned char>())) {
+        case snapshot_tag::nil:
+            lua_pushnil(L);
+            break;
+        case snapshot_tag::boolean_false:
+            lua_pushboolean(L, 0);
+            break;
+        case snapshot_tag::boolean_true:
+            lua_pushboolean(L, 1);
+            break;
+        case snapshot_tag::number:
+            lua_pushnumber(L, get<lua_Number>());
+            break;
+        case snapshot_tag::string: {
+            std::uint32_t size = get<std::uint32_t>();
+            lua_pushlstring(L, take(size), size);
+            break;
+        }
+        case snapshot_tag::table: {
+            std::uint32_t narr = get<std::uint32_t>();
+            std::uint32_t nrec = get<std::uint32_t>();
+            // every entry is written later as a key and a value of at least one byte each
+            if(static_cast<std::uint64_t>(narr) + nrec > static_cast<std::uint64_t>(end - pos) / 2) {
+                throw error("snapshot table is larger than the data left");
+            }
+            lua_createtable(L, static_cast<int>(narr), static_cast<int>(nrec));
+            remember();
+            break;
+        }
+        case snapshot_tag::userdata:
+            get_userdata();
+            remember();
+            break;
+        case snapshot_tag::reference: {
+            std::uint32_t id = get<std::uint32_t>();
+            if(id >= static_cast<std::uint32_t>(next_id)) {
+                throw error("snapshot refers to a value that does not exist");
+            }
+            lua_rawgeti(L, ids, static_cast<int>(id) + 1);
+            break;
+        }
+        default:
+            throw error("snapshot contains an unknown value");
+        }
+    }
+
+    void run() {
+        for(int id = 1; id <= next_id; ++id) {
+            lua_rawgeti(L, ids, id);
+            if(!lua_istable(L, -1)) {
+                lua_pop(L, 1);
+                continue;
+            }
+            int target = lua_gettop(L);
+            std::uint32_t count = get<std::uint32_t>();
+            if(count > static_cast<std::size_t>(end - pos) / 2) {
+                throw error("snapshot table is larger than the data left");
+            }
+            for(std::uint32_t i = 0; i < count; ++i) {
+                get_value();
+                get_value();
+                if(lua_isnil(L, -2) || lua_tonumber(L, -2) != lua_tonumber(L, -2)) {
+                    throw error("snapshot contains an invalid table key");
+                }
+                lua_rawset(L, target);
+            }
+            lua_pop(L, 1);
+        }
+        if(pos != end) {
+            throw error("snapshot has trailing data");
+        }
+    }
+};
+} // detail
+
+// lets userdata of type T be saved and loaded in snapshots using snapshot_traits<T>
+template<typename T>
+void enable_snapshot(lua_State* L) {
+    luaL_newmetatable(L, userdata_traits<T>::metatable.c_str());
+    lua_pushlightuserdata(L, const_cast<detail::snapshot_hook*>(&detail::snapshot_hook_for<T>::value));
+    lua_setfield(L, -2, detail::snapshot_hook_key);
+    lua_pop(L, 1);
+}
+
+// appends a snapshot of the value at index to out
+inline void save_snapshot(lua_State* L, int index, std::string& out) {
+    index = lua_absindex(L, index);
+    int top = lua_gettop(L);
+    try {
+        detail::snapshot_writer writer(L, out);
+        writer.put_value(index);
+        writer.run();
+    }
+    catch(...) {
+        lua_settop(L, top);
+        throw;
+    }
+    lua_settop(L, top);
+}
+
+inline std::string save_snapshot(const reference& value) {
+    std::string out;
+    value.push();
+    lua_State* L = value.state();
+    try {
+        save_snapshot(L, -1, out);
+    }
+    catch(...) {
+        lua_pop(L, 1);
+        throw;
+    }
+    lua_pop(L, 1);
+    return out;
+}
+
+inline void write_snapshot(const reference& value, const std::string& filename) {
+    std::string contents = save_snapshot(value);
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file) {
+        throw error("unable to open file for writing: " + filename);
+    }
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    if(!file) {
+        throw error("unable to write snapshot: " + filename);
+    }
+}
+
+// pushes the value stored in a snapshot
+inline void load_snapshot(lua_State* L, const char* data, std::size_t size) {
+    int top = lua_gettop(L);
+    try {
+        detail::snapshot_reader reader(L, data, size);
+        reader.get_value();
+        reader.run();
+    }
+    catch(...) {
+        lua_settop(L, top);
+        throw;
+    }
+    lua_replace(L, top + 1);
+    lua_settop(L, top + 1);
+}
+
+inline object load_snapshot(lua_State* L, const std::string& data) {
+    load_snapshot(L, data.data(), data.size());
+    object result(L);
+    lua_pop(L, 1);
+    return result;
+}
+
+// strings are copied out of the mapping as they are pushed, so the file is only mapped while loading
+inline object read_snapshot(lua_State* L, const std::string& filename) {
+    detail::mapped_file file(filename);
+    load_snapshot(L, file.data(), file.size());
+    object result(L);
+    lua_pop(L, 1);
+    return result;
+}
+} // sol
+
+#endif // SOL_SNAPSHOT_HPP
@@ -27,10 +27,12 @@
 #include "tuple.hpp"
 #include "traits.hpp"
 #include "userdata_traits.hpp"
+#include "instances.hpp"
 #include <utility>
 #include <array>
 #include <cstring>
 #include <functional>
+#include <tuple>
 
 namespace sol {
 namespace detail {
@@ -80,7 +82,13 @@ inline void push_userdata(lua_State* L, Key&& metatablekey, Args&&... args) {
     std::allocator<T> alloc{};
     alloc.construct(pdatum, std::forward<Args>(args)...);
     luaL_getmetatable(L, std::addressof(metatablekey[0]));
+    // without a metatable there is no __gc to take the accounting back off,
+    // and objects pushed by pointer belong to someone else
+    bool collected = !lua_isnil(L, -1) && !std::is_pointer<T>::value;
     lua_setmetatable(L, -2);
+    if(collected) {
+        sol::detail::userdata_created(L, *pdatum);
+    }
 }
 } // detail
 template<typename T, typename X = void>
@@ -401,31 +409,22 @@ inline void push_tuple(lua_State* L, indices<I...>, T&& tuplen) {
     swallow {'\0', (sol::stack::push(L, std::get<I>(tuplen)), '\0')... };
 }
 
-template<typename F, typename... Vs, typename... Args>
-inline auto ltr_get(lua_State*, int, F&& f, types<Args...>, types<>, Vs&&... vs) -> decltype(f(std::forward<Vs>(vs)...)) {
-    return f(std::forward<Vs>(vs)...);
-}
-template<typename F, typename Head, typename... Tail, typename... Vs, typename... Args>
-inline auto ltr_get(lua_State* L, int index, F&& f, types<Args...>, types<Head, Tail...>, Vs&&... vs) -> decltype(f(std::declval<Args>()...)) {
-    return ltr_get(L, index + 1, std::forward<F>(f), types<Args...>(), types<Tail...>(), std::forward<Vs>(vs)..., stack::get<Head>(L, index));
-}
-
-template<typename F, typename... Vs, typename... Args>
-inline auto ltr_pop(lua_State*, F&& f, types<Args...>, types<>, Vs&&... vs) -> decltype(f(std::forward<Vs>(vs)...)) {
-    return f(std::forward<Vs>(vs)...);
-}
-template<typename F, typename Head, typename... Tail, typename... Vs, typename... Args>
-inline auto ltr_pop(lua_State* L, F&& f, types<Args...> t, types<Head, Tail...>, Vs&&... vs) -> decltype(f(std::declval<Args>()...)) {
-    return ltr_pop(L, std::forward<F>(f), t, types<Tail...>(), std::forward<Vs>(vs)..., stack::pop<Head>(L));
+// one flat expansion per signature instead of a recursive instantiation per argument;
+// the arguments sit at fixed indices, so the order the getters run in does not matter
+template<typename F, typename... Args, std::size_t... I, typename... Vs>
+inline auto get_indexed(lua_State* L, int index, F&& f, types<Args...>, indices<I...>, Vs&&... vs) -> decltype(f(std::forward<Vs>(vs)..., stack::get<Args>(L, index)...)) {
+    return f(std::forward<Vs>(vs)..., stack::get<Args>(L, index + static_cast<int>(I))...);
 }
 
-template<typename F, typename... Vs, typename... Args>
-inline auto rtl_pop(lua_State*, F&& f, types<Args...>, types<>, Vs&&... vs) -> decltype(f(std::forward<Vs>(vs)...)) {
-    return f(std::forward<Vs>(vs)...);
-}
-template<typename F, typename Head, typename... Tail, typename... Vs, typename... Args>
-inline auto rtl_pop(lua_State* L, F&& f, types<Args...> t, types<Head, Tail...>, Vs&&... vs) -> decltype(f(std::declval<Args>()...)) {
-    return rtl_pop(L, std::forward<F>(f), t, types<Tail...>(), stack::pop<Head>(L), std::forward<Vs>(vs)...);
+// the arguments are taken off the stack before f runs; with top_first the first argument
+// is the one on top, as when popping them one by one
+template<typename F, typename... Args, std::size_t... I>
+inline auto pop_indexed(lua_State* L, F&& f, types<Args...>, indices<I...>, bool top_first) -> decltype(f(std::declval<Args>()...)) {
+    const int count = static_cast<int>(sizeof...(Args));
+    const int top = lua_gettop(L);
+    std::tuple<decltype(stack::get<Args>(L))...> values{ stack::get<Args>(L, top_first ? top - static_cast<int>(I) : top - count + 1 + static_cast<int>(I))... };
+    lua_pop(L, count);
+    return f(std::get<I>(std::move(values))...);
 }
 } // detail
 
@@ -456,8 +455,8 @@ inline void push_reverse(lua_State* L, std::tuple<Args...>&& tuplen) {
 }
 
 template<typename... Args, typename TFx, typename... Vs>
-inline auto get_call(lua_State* L, int index, TFx&& fx, types<Args...> t, Vs&&... vs) -> decltype(detail::ltr_get(L, index, std::forward<TFx>(fx), t, t, std::forward<Vs>(vs)...)) {
-    return detail::ltr_get(L, index, std::forward<TFx>(fx), t, t, std::forward<Vs>(vs)...);
+inline auto get_call(lua_State* L, int index, TFx&& fx, types<Args...> t, Vs&&... vs) -> decltype(detail::get_indexed(L, index, std::forward<TFx>(fx), t, t, std::forward<Vs>(vs)...)) {
+    return detail::get_indexed(L, index, std::forward<TFx>(fx), t, t, std::forward<Vs>(vs)...);
 }
 
 template<typename TFx, typename... Args, typename... Vs>
@@ -466,19 +465,22 @@ inline auto get_call(lua_State* L, TFx&& fx, types<Args...> t, Vs&&... vs) -> de
 }
 
 template<typename... Args, typename TFx>
-inline auto pop_call(lua_State* L, TFx&& fx, types<Args...> t) -> decltype(detail::ltr_pop(L, std::forward<TFx>(fx), t, t)) {
-    return detail::ltr_pop(L, std::forward<TFx>(fx), t, t);
+inline auto pop_call(lua_State* L, TFx&& fx, types<Args...> t) -> decltype(detail::pop_indexed(L, std::forward<TFx>(fx), t, t, true)) {
+    return detail::pop_indexed(L, std::forward<TFx>(fx), t, t, true);
 }
 
 template<typename... Args, typename TFx>
-inline auto pop_reverse_call(lua_State* L, TFx&& fx, types<Args...> t) -> decltype(detail::rtl_pop(L, std::forward<TFx>(fx), t, reversed<Args...>())) {
-    return detail::rtl_pop(L, std::forward<TFx>(fx), t, reversed<Args...>());
+inline auto pop_reverse_call(lua_State* L, TFx&& fx, types<Args...> t) -> decltype(detail::pop_indexed(L, std::forward<TFx>(fx), t, t, false)) {
+    return detail::pop_indexed(L, std::forward<TFx>(fx), t, t, false);
 }
 
 inline call_syntax get_call_syntax(lua_State* L, const std::string& meta) {
     if(get<type>(L, 1) == type::table) {
-        if(luaL_newmetatable(L, meta.c_str()) == 0) {
-            lua_settop(L, -2);
+        // luaL_newmetatable would leave behind a new metatable when there is none
+        luaL_getmetatable(L, meta.c_str());
+        bool registered = !lua_isnil(L, -1);
+        lua_pop(L, 1);
+        if(registered) {
             return call_syntax::colon;
         }
     }
@@ -0,0 +1,131 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_STACK_GUARD_HPP
+#define SOL_STACK_GUARD_HPP
+
+#include "types.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+namespace sol {
+typedef void (*stack_imbalance_handler)(lua_State* L, int expected, int actual);
+
+namespace detail {
+inline void abort_on_imbalance(lua_State*, int expected, int actual) {
+    std::fprintf(stderr, "sol: unbalanced stack, expected %d values but found %d\n", expected, actual);
+    std::abort();
+}
+
+struct stack_audit_state {
+    std::atomic<bool> enabled;
+    std::atomic<int> high_water;
+    std::atomic<std::size_t> imbalances;
+    std::atomic<stack_imbalance_handler> handler;
+};
+
+inline stack_audit_state& stack_audit() {
+#ifdef SOL_CHECK_STACK
+    static stack_audit_state audit{ { true }, { 0 }, { 0 }, { &abort_on_imbalance } };
+#else
+    static stack_audit_state audit{ { false }, { 0 }, { 0 }, { &abort_on_imbalance } };
+#endif // SOL_CHECK_STACK
+    return audit;
+}
+
+inline void observe_stack(stack_audit_state& audit, int top) noexcept {
+    int seen = audit.high_water.load(std::memory_order_relaxed);
+    while(top > seen && !audit.high_water.compare_exchange_weak(seen, top, std::memory_order_relaxed)) {}
+}
+} // detail
+
+// Puts the stack back to where it was when the guard was made, so values an entry
+// point pushes are gone once it returns or throws. While auditing, which defining
+// SOL_CHECK_STACK turns on by default, a guard left on a normal return with a different
+// top reports it to the imbalance handler, and the tops guards see feed a high-water mark.
+class stack_guard {
+private:
+    lua_State* L;
+    int top;
+public:
+    explicit stack_guard(lua_State* L) noexcept: L(L), top(lua_gettop(L)) {
+        detail::stack_audit_state& audit = detail::stack_audit();
+        if(audit.enabled.load(std::memory_order_relaxed)) {
+            detail::observe_stack(audit, top);
+        }
+    }
+
+    stack_guard(const stack_guard&) = delete;
+    stack_guard& operator=(const stack_guard&) = delete;
+
+    ~stack_guard() {
+        int now = lua_gettop(L);
+        detail::stack_audit_state& audit = detail::stack_audit();
+        if(audit.enabled.load(std::memory_order_relaxed)) {
+            detail::observe_stack(audit, now);
+            if(now != top && !std::uncaught_exception()) {
+                audit.imbalances.fetch_add(1, std::memory_order_relaxed);
+                audit.handler.load(std::memory_order_relaxed)(L, top, now);
+            }
+        }
+        if(now != top) {
+            lua_settop(L, top);
+        }
+    }
+
+    int saved() const noexcept {
+        return top;
+    }
+};
+
+inline void audit_stack(bool enabled) noexcept {
+    detail::stack_audit().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+inline bool auditing_stack() noexcept {
+    return detail::stack_audit().enabled.load(std::memory_order_relaxed);
+}
+
+// called while auditing with the expected and actual top of an unbalanced guard,
+// the default handler prints both and aborts
+inline void on_stack_imbalance(stack_imbalance_handler handler) noexcept {
+    detail::stack_audit().handler.store(handler != nullptr ? handler : &detail::abort_on_imbalance, std::memory_order_relaxed);
+}
+
+// the highest top any guard has seen while auditing
+inline int stack_high_water() noexcept {
+    return detail::stack_audit().high_water.load(std::memory_order_relaxed);
+}
+
+inline std::size_t stack_imbalances() noexcept {
+    return detail::stack_audit().imbalances.load(std::memory_order_relaxed);
+}
+
+inline void reset_stack_audit() noexcept {
+    detail::stack_audit().high_water.store(0, std::memory_order_relaxed);
+    detail::stack_audit().imbalances.store(0, std::memory_order_relaxed);
+}
+} // sol
+
+#endif // SOL_STACK_GUARD_HPP
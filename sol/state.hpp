@@ -24,14 +24,68 @@
 
 #include "error.hpp"
 #include "table.hpp"
+#include "environment.hpp"
+#include "gc.hpp"
+#include "bundle.hpp"
+#include "allocator.hpp"
 #include <memory>
 
 namespace sol {
 namespace detail {
 inline int atpanic(lua_State* L) {
-    std::string err = lua_tostring(L, -1);
+    const char* message = lua_tostring(L, -1);
+    std::string err = message != nullptr ? message : "unknown error (error object is not a string)";
     throw error(err);
 }
+
+const char baseline_key[] = "sol.baseline";
+
+// pushes a shallow copy of the table at index
+inline void copy_table(lua_State* L, int index) {
+    index = lua_absindex(L, index);
+    lua_createtable(L, 0, 64);
+    lua_pushnil(L);
+    while(lua_next(L, index) != 0) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, -4);
+    }
+}
+
+// makes the table at target hold exactly the keys and values of the table at snapshot
+inline void restore_table(lua_State* L, int target, int snapshot) {
+    target = lua_absindex(L, target);
+    snapshot = lua_absindex(L, snapshot);
+    lua_pushnil(L);
+    while(lua_next(L, target) != 0) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_rawget(L, snapshot);
+        bool keep = !lua_isnil(L, -1);
+        lua_pop(L, 1);
+        if(!keep) {
+            // clearing a field during traversal is allowed
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, target);
+        }
+    }
+
+    lua_pushnil(L);
+    while(lua_next(L, snapshot) != 0) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, target);
+    }
+}
+
+inline lua_State* new_state(lua_Alloc allocator, void* userdata) {
+    lua_State* L = lua_newstate(allocator, userdata);
+    if(L == nullptr) {
+        throw memory_error("unable to allocate a new lua state");
+    }
+    return L;
+}
 } // detail
 
 enum class lib : char {
@@ -61,6 +115,18 @@ public:
         lua_atpanic(L.get(), detail::atpanic);
     }
 
+    state(lua_Alloc allocator, void* userdata):
+    L(detail::new_state(allocator, userdata), lua_close),
+    reg(L.get(), LUA_REGISTRYINDEX),
+    global(reg.get<table>(LUA_RIDX_GLOBALS)) {
+        lua_atpanic(L.get(), detail::atpanic);
+    }
+
+    // the allocator is any object callable as void*(void* ptr, std::size_t osize, std::size_t nsize)
+    // it is not copied and must outlive the state
+    template<typename Allocator, DisableIf<std::is_same<Allocator, state>> = 0>
+    explicit state(Allocator& allocator): state(&detail::allocate<Allocator>, std::addressof(allocator)) {}
+
     lua_State* lua_state() const {
         return L.get();
     }
@@ -124,15 +190,158 @@ public:
     }
 
     void script(const std::string& code) {
-        if(luaL_dostring(L.get(), code.c_str())) {
-            lua_error(L.get());
+        SOL_TRACE_SCOPE(trace_kind::load, 0, code.size());
+        stack_guard guard(L.get());
+        int status = luaL_loadstring(L.get(), code.c_str());
+        if(status == LUA_OK) {
+            status = lua_pcall(L.get(), 0, 0, 0);
+        }
+        if(status != LUA_OK) {
+            detail::throw_status(L.get(), status);
         }
     }
 
     void open_file(const std::string& filename) {
-        if(luaL_dofile(L.get(), filename.c_str())) {
-            lua_error(L.get());
+        SOL_TRACE_SCOPE(trace_kind::load, 0, 0);
+        stack_guard guard(L.get());
+        int status = luaL_loadfile(L.get(), filename.c_str());
+        if(status == LUA_OK) {
+            status = lua_pcall(L.get(), 0, 0, 0);
+        }
+        if(status != LUA_OK) {
+            detail::throw_status(L.get(), status);
+        }
+    }
+
+    // compiles a chunk without running it
+    function load(const std::string& code) {
+        stack_guard guard(L.get());
+        int status = luaL_loadstring(L.get(), code.c_str());
+        if(status != LUA_OK) {
+            detail::throw_status(L.get(), status);
+        }
+        function result(L.get());
+        lua_pop(L.get(), 1);
+        return result;
+    }
+
+    // runs a chunk with env as its globals
+    void script(const std::string& code, const environment& env) {
+        SOL_TRACE_SCOPE(trace_kind::load, 0, code.size());
+        function chunk = load(code);
+        env.set_on(chunk);
+        chunk();
+    }
+
+    void open_file(const std::string& filename, const environment& env) {
+        SOL_TRACE_SCOPE(trace_kind::load, 0, 0);
+        stack_guard guard(L.get());
+        int status = luaL_loadfile(L.get(), filename.c_str());
+        if(status != LUA_OK) {
+            detail::throw_status(L.get(), status);
         }
+        function chunk(L.get());
+        lua_pop(L.get(), 1);
+        env.set_on(chunk);
+        chunk();
+    }
+
+    // an empty environment whose missing globals are read from this state's globals
+    environment create_environment() const {
+        return environment(L.get(), global);
+    }
+
+    // Remembers the current globals and package.loaded entries, keys and values, so that
+    // reset can bring the state back to this point. Typically called once setup is done.
+    void mark_baseline() {
+        lua_State* S = L.get();
+        lua_createtable(S, 0, 3);
+        lua_pushglobaltable(S);
+        detail::copy_table(S, -1);
+        lua_setfield(S, -3, "globals");
+        if(lua_getmetatable(S, -1) != 0) {
+            lua_setfield(S, -3, "metatable");
+        }
+        lua_pop(S, 1);
+        lua_getfield(S, LUA_REGISTRYINDEX, "_LOADED");
+        if(lua_istable(S, -1)) {
+            detail::copy_table(S, -1);
+            lua_setfield(S, -3, "loaded");
+        }
+        lua_pop(S, 1);
+        lua_setfield(S, LUA_REGISTRYINDEX, detail::baseline_key);
+    }
+
+    // Restores the globals and package.loaded to the last mark_baseline by diffing them against it.
+    // Registered userdata, library tables and anything kept in the registry are left alone, though
+    // changes made inside tables that are themselves part of the baseline are not undone.
+    void reset() {
+        lua_State* S = L.get();
+        lua_getfield(S, LUA_REGISTRYINDEX, detail::baseline_key);
+        if(!lua_istable(S, -1)) {
+            lua_pop(S, 1);
+            throw error("state::reset called without a baseline, call state::mark_baseline first");
+        }
+        int baseline = lua_gettop(S);
+
+        lua_pushglobaltable(S);
+        lua_getfield(S, baseline, "globals");
+        detail::restore_table(S, -2, -1);
+        lua_pop(S, 1);
+        lua_getfield(S, baseline, "metatable");
+        lua_setmetatable(S, -2);
+        lua_pop(S, 1);
+
+        lua_getfield(S, baseline, "loaded");
+        if(lua_istable(S, -1)) {
+            lua_getfield(S, LUA_REGISTRYINDEX, "_LOADED");
+            if(lua_istable(S, -1)) {
+                detail::restore_table(S, -1, -2);
+            }
+            lua_pop(S, 1);
+        }
+        lua_pop(S, 2);
+    }
+
+    // bytes currently allocated by the state, as seen by the collector
+    std::size_t memory_used() const {
+        return gc().memory();
+    }
+
+    garbage_collector gc() const {
+        return garbage_collector(L.get());
+    }
+
+    // bytes owned outside of the state by its userdata, see external_memory_traits
+    std::size_t external_memory() const {
+        return sol::external_memory(L.get());
+    }
+
+    state& add_external_memory(std::size_t bytes) {
+        sol::add_external_memory(L.get(), bytes);
+        return *this;
+    }
+
+    state& remove_external_memory(std::size_t bytes) {
+        sol::remove_external_memory(L.get(), bytes);
+        return *this;
+    }
+
+    // live, peak and byte counts of the T userdata owned by the state
+    template<typename T>
+    instance_count instances() const {
+        return sol::instances<T>(L.get());
+    }
+
+    std::vector<std::pair<std::string, instance_count>> instances() const {
+        return sol::instances(L.get());
+    }
+
+    // resolves require calls from the bundle before probing package.path
+    // the bundle must outlive the state
+    state& add_bundle(const bundle& modules) {
+        modules.add_searcher(L.get());
+        return *this;
     }
 
     template<typename... Args, typename... Keys>
@@ -235,6 +444,25 @@ public:
         return *this;
     }
 };
+namespace detail {
+struct arena_holder {
+    arena_allocator arena;
+
+    arena_holder(std::size_t chunk_size, std::size_t capacity): arena(chunk_size, capacity) {}
+};
+} // detail
+
+// A throwaway state that allocates from its own arena. Destroying it runs every finalizer,
+// including the destructors of registered userdata, then hands the arena back in one go.
+class arena_state : private detail::arena_holder, public state {
+public:
+    explicit arena_state(std::size_t chunk_size = 256 * 1024, std::size_t capacity = 0):
+    detail::arena_holder(chunk_size, capacity), state(arena) {}
+
+    const arena_allocator& allocator() const noexcept {
+        return arena;
+    }
+};
 } // sol
 
 #endif // SOL_STATE_HPP
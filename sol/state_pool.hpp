@@ -0,0 +1,240 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_STATE_POOL_HPP
+#define SOL_STATE_POOL_HPP
+
+#include "state.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace sol {
+// A thread safe pool of pre-warmed states. Each state is built once by the setup callback and
+// then handed out through RAII handles, which give the state back when they are destroyed.
+// The pool grows up to max_size states under load, and states that sit idle for longer than
+// the idle timeout are destroyed until only min_size of them remain. With reset_globals, a state
+// is brought back to its post-setup baseline (see state::reset) whenever it is given back.
+class state_pool {
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct idle_state {
+        std::unique_ptr<state> lua;
+        clock::time_point since;
+    };
+
+    std::function<void(state&)> setup;
+    std::size_t min_states;
+    std::size_t max_states;
+    bool reset_globals;
+    clock::duration timeout = std::chrono::seconds(30);
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<idle_state> idle_states;
+    std::size_t total = 0;
+
+    std::unique_ptr<state> create() {
+        std::unique_ptr<state> lua(new state());
+        setup(*lua);
+        if(reset_globals) {
+            lua->mark_baseline();
+        }
+        return lua;
+    }
+
+    // must be called with the mutex held, the expired states are destroyed by the caller
+    void take_expired(std::deque<idle_state>& expired, clock::time_point now, bool everything) {
+        while(idle_states.size() > min_states && (everything || now - idle_states.front().since > timeout)) {
+            expired.push_back(std::move(idle_states.front()));
+            idle_states.pop_front();
+            --total;
+        }
+    }
+
+    void discard() {
+        std::lock_guard<std::mutex> lock(mutex);
+        --total;
+        available.notify_one();
+    }
+
+    void checkin(std::unique_ptr<state> lua) noexcept {
+        if(reset_globals) {
+            try {
+                lua->reset();
+            }
+            catch(...) {
+                lua.reset();
+                discard();
+                return;
+            }
+        }
+
+        std::deque<idle_state> expired;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            clock::time_point now = clock::now();
+            idle_states.push_back({ std::move(lua), now });
+            take_expired(expired, now, false);
+        }
+        available.notify_one();
+    }
+public:
+    class handle {
+    private:
+        friend class state_pool;
+        state_pool* pool = nullptr;
+        std::unique_ptr<state> lua;
+
+        handle(state_pool& pool, std::unique_ptr<state> lua) noexcept: pool(&pool), lua(std::move(lua)) {}
+    public:
+        handle() noexcept = default;
+        handle(handle&&) noexcept = default;
+
+        handle& operator=(handle&& o) noexcept {
+            release();
+            pool = o.pool;
+            lua = std::move(o.lua);
+            return *this;
+        }
+
+        ~handle() {
+            release();
+        }
+
+        // gives the state back to the pool early
+        void release() noexcept {
+            if(lua != nullptr) {
+                pool->checkin(std::move(lua));
+            }
+        }
+
+        state& operator*() const noexcept {
+            return *lua;
+        }
+
+        state* operator->() const noexcept {
+            return lua.get();
+        }
+
+        state* get() const noexcept {
+            return lua.get();
+        }
+
+        explicit operator bool() const noexcept {
+            return lua != nullptr;
+        }
+    };
+private:
+    // both must be called with the mutex held
+    bool can_take() const noexcept {
+        return !idle_states.empty() || total < max_states;
+    }
+
+    handle take(std::unique_lock<std::mutex>& lock) {
+        if(!idle_states.empty()) {
+            std::unique_ptr<state> lua = std::move(idle_states.back().lua);
+            idle_states.pop_back();
+            return handle(*this, std::move(lua));
+        }
+
+        ++total;
+        lock.unlock();
+        try {
+            return handle(*this, create());
+        }
+        catch(...) {
+            discard();
+            throw;
+        }
+    }
+
+public:
+    state_pool(std::function<void(state&)> setup, std::size_t min_size, std::size_t max_size, bool reset_globals = true):
+    setup(std::move(setup)), min_states(min_size), max_states(max_size < min_size ? min_size : max_size), reset_globals(reset_globals) {
+        if(max_states == 0) {
+            throw error("a state pool must be able to hold at least one state");
+        }
+        for(std::size_t i = 0; i < min_states; ++i) {
+            idle_states.push_back({ create(), clock::now() });
+            ++total;
+        }
+    }
+
+    state_pool(const state_pool&) = delete;
+    state_pool& operator=(const state_pool&) = delete;
+
+    // handles must not outlive the pool
+    ~state_pool() = default;
+
+    // blocks until a state is free or the pool is allowed to grow
+    handle checkout() {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this] { return can_take(); });
+        return take(lock);
+    }
+
+    // returns an empty handle instead of blocking when the pool is exhausted
+    handle try_checkout() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(!can_take()) {
+            return handle();
+        }
+        return take(lock);
+    }
+
+    // destroys every idle state above the minimum size
+    void shrink() {
+        std::deque<idle_state> expired;
+        std::lock_guard<std::mutex> lock(mutex);
+        take_expired(expired, clock::now(), true);
+    }
+
+    template<typename Rep, typename Period>
+    void idle_timeout(std::chrono::duration<Rep, Period> duration) {
+        std::lock_guard<std::mutex> lock(mutex);
+        timeout = std::chrono::duration_cast<clock::duration>(duration);
+    }
+
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return total;
+    }
+
+    std::size_t idle() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return idle_states.size();
+    }
+
+    std::size_t min_size() const noexcept {
+        return min_states;
+    }
+
+    std::size_t max_size() const noexcept {
+        return max_states;
+    }
+};
+} // sol
+
+#endif // SOL_STATE_POOL_HPP
@@ -32,6 +32,7 @@ class table : public reference {
     friend class state;
     template<typename T, typename U>
     typename stack::get_return<T>::type single_get(U&& key) const {
+        stack_guard guard(state());
         push();
         stack::push(state(), std::forward<U>(key));
         lua_gettable(state(), -2);
@@ -75,6 +76,7 @@ public:
 
     template<typename T, typename U>
     table& set(T&& key, U&& value) {
+        stack_guard guard(state());
         push();
         stack::push(state(), std::forward<T>(key));
         stack::push(state(), std::forward<U>(value));
@@ -90,6 +92,7 @@ public:
 
     template<typename Key, typename T>
     table& set_userdata(Key&& key, userdata<T>& user) {
+        stack_guard guard(state());
         push();
         stack::push(state(), std::forward<Key>(key));
         stack::push(state(), user);
@@ -99,8 +102,11 @@ public:
     }
 
     size_t size() const {
+        stack_guard guard(state());
         push();
-        return lua_rawlen(state(), -1);
+        size_t result = lua_rawlen(state(), -1);
+        lua_pop(state(), 1);
+        return result;
     }
 
     template<typename T>
@@ -168,9 +174,11 @@ private:
     template<typename... Sig, typename... Args, typename Key>
     void set_resolved_function(Key&& key, Args&&... args) {
         std::string fkey(std::forward<Key>(key));
+        stack_guard guard(state());
         push();
         int tabletarget = lua_gettop(state());
         stack::push<function_sig_t<Sig...>>(state(), std::forward<Args>(args)...);
+        detail::default_metrics::attach(state(), -1, fkey);
         lua_setfield(state(), tabletarget, fkey.c_str());
         pop();
     }
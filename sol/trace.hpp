@@ -0,0 +1,272 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_TRACE_HPP
+#define SOL_TRACE_HPP
+
+#include "error.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Number of records kept per thread, older records are overwritten.
+#ifndef SOL_TRACE_CAPACITY
+#define SOL_TRACE_CAPACITY 8192
+#endif // SOL_TRACE_CAPACITY
+
+namespace sol {
+enum class trace_kind : std::uint16_t {
+    // a C++ function bound to Lua being called, id is the bound function, value the argument count
+    binding_call = 1,
+    // a Lua function called through sol::function, id is its address
+    function_call,
+    // state::script or state::open_file, value is the size of the code or 0 for files
+    load,
+    // a collection or step run through garbage_collector, value is the step size in kb
+    gc_step
+};
+
+enum class trace_phase : std::uint16_t {
+    begin,
+    end
+};
+
+struct trace_record {
+    std::uint64_t nanoseconds;
+    std::uint64_t id;
+    std::uint64_t value;
+    std::uint32_t thread;
+    trace_kind kind;
+    trace_phase phase;
+};
+
+namespace detail {
+const char trace_magic[] = "SOLT";
+const std::uint32_t trace_version = 1;
+const std::size_t trace_capacity = SOL_TRACE_CAPACITY;
+
+// Written by its own thread only. A record is claimed, stored as four relaxed atomic
+// words and then published by bumping head, so a ring can be copied while it is being
+// written to and whatever the writer claimed in the meantime is thrown away.
+struct trace_ring {
+    std::uint32_t thread;
+    std::atomic<std::uint64_t> claimed;
+    std::atomic<std::uint64_t> head;
+    std::array<std::array<std::atomic<std::uint64_t>, 4>, trace_capacity> records;
+
+    explicit trace_ring(std::uint32_t thread): thread(thread), claimed(0), head(0) {}
+
+    void write(trace_kind kind, trace_phase phase, std::uint64_t id, std::uint64_t value) noexcept {
+        std::uint64_t at = head.load(std::memory_order_relaxed);
+        std::uint64_t now = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count());
+        claimed.store(at + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto& r = records[at % trace_capacity];
+        r[0].store(now, std::memory_order_relaxed);
+        r[1].store(id, std::memory_order_relaxed);
+        r[2].store(value, std::memory_order_relaxed);
+        r[3].store(static_cast<std::uint64_t>(kind) | static_cast<std::uint64_t>(phase) << 16, std::memory_order_relaxed);
+        head.store(at + 1, std::memory_order_release);
+    }
+
+    void copy(std::vector<trace_record>& out) const {
+        std::uint64_t end = head.load(std::memory_order_acquire);
+        std::uint64_t begin = end > trace_capacity ? end - trace_capacity : 0;
+        std::size_t first = out.size();
+        for(std::uint64_t i = begin; i < end; ++i) {
+            auto& r = records[i % trace_capacity];
+            std::uint64_t packed = r[3].load(std::memory_order_relaxed);
+            out.push_back(trace_record{ r[0].load(std::memory_order_relaxed), r[1].load(std::memory_order_relaxed),
+                                        r[2].load(std::memory_order_relaxed), thread,
+                                        static_cast<trace_kind>(packed & 0xFFFF), static_cast<trace_phase>(packed >> 16 & 0xFFFF) });
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::uint64_t after = claimed.load(std::memory_order_relaxed);
+        if(after > trace_capacity && after - trace_capacity > begin) {
+            std::uint64_t overwritten = std::min(after - trace_capacity - begin, end - begin);
+            out.erase(out.begin() + static_cast<std::ptrdiff_t>(first), out.begin() + static_cast<std::ptrdiff_t>(first + overwritten));
+        }
+    }
+};
+
+// rings outlive their threads so a dump still shows what finished threads were doing
+struct trace_registry {
+    std::mutex lock;
+    std::vector<std::shared_ptr<trace_ring>> rings;
+};
+
+inline trace_registry& trace_rings() {
+    static trace_registry registry;
+    return registry;
+}
+
+inline trace_ring& this_thread_trace() {
+    static thread_local std::shared_ptr<trace_ring> ring;
+    if(!ring) {
+        trace_registry& registry = trace_rings();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        ring = std::make_shared<trace_ring>(static_cast<std::uint32_t>(registry.rings.size()));
+        registry.rings.push_back(ring);
+    }
+    return *ring;
+}
+
+template<typename T>
+inline void trace_put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+inline T trace_get(const char*& data, const char* end) {
+    if(static_cast<std::size_t>(end - data) < sizeof(T)) {
+        throw error("trace is truncated");
+    }
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+} // detail
+
+inline void trace(trace_kind kind, trace_phase phase, std::uint64_t id, std::uint64_t value = 0) noexcept {
+    detail::this_thread_trace().write(kind, phase, id, value);
+}
+
+// records the begin of an event now and its end when it goes out of scope,
+// exceptions included
+class trace_scope {
+private:
+    trace_kind kind;
+    std::uint64_t id;
+    std::uint64_t value;
+public:
+    trace_scope(trace_kind kind, std::uint64_t id, std::uint64_t value = 0) noexcept: kind(kind), id(id), value(value) {
+        trace(kind, trace_phase::begin, id, value);
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+    ~trace_scope() {
+        trace(kind, trace_phase::end, id, value);
+    }
+};
+
+// every record still held by any thread's ring, oldest first
+inline std::vector<trace_record> trace_records() {
+    std::vector<std::shared_ptr<detail::trace_ring>> rings;
+    {
+        detail::trace_registry& registry = detail::trace_rings();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        rings = registry.rings;
+    }
+    std::vector<trace_record> records;
+    for(auto&& ring : rings) {
+        ring->copy(records);
+    }
+    std::stable_sort(records.begin(), records.end(), [](const trace_record& a, const trace_record& b) {
+        return a.nanoseconds < b.nanoseconds;
+    });
+    return records;
+}
+
+// "SOLT", a version and a record count followed by the records, 32 bytes each,
+// in the byte order of the machine that wrote them
+inline std::string dump_trace() {
+    std::vector<trace_record> records = trace_records();
+    std::string out(detail::trace_magic, 4);
+    out.reserve(16 + records.size() * 32);
+    detail::trace_put(out, detail::trace_version);
+    detail::trace_put(out, static_cast<std::uint64_t>(records.size()));
+    for(auto&& r : records) {
+        detail::trace_put(out, r.nanoseconds);
+        detail::trace_put(out, r.id);
+        detail::trace_put(out, r.value);
+        detail::trace_put(out, r.thread);
+        detail::trace_put(out, static_cast<std::uint16_t>(r.kind));
+        detail::trace_put(out, static_cast<std::uint16_t>(r.phase));
+    }
+    return out;
+}
+
+inline void dump_trace(const std::string& filename) {
+    std::string data = dump_trace();
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file.write(data.data(), static_cast<std::streamsize>(data.size()))) {
+        throw error("unable to write trace: " + filename);
+    }
+}
+
+inline std::vector<trace_record> read_trace(const char* data, std::size_t size) {
+    const char* end = data + size;
+    if(size < 4 || std::memcmp(data, detail::trace_magic, 4) != 0) {
+        throw error("not a trace");
+    }
+    data += 4;
+    if(detail::trace_get<std::uint32_t>(data, end) != detail::trace_version) {
+        throw error("unsupported trace version");
+    }
+    std::uint64_t count = detail::trace_get<std::uint64_t>(data, end);
+    if(count > static_cast<std::uint64_t>(end - data) / 32) {
+        throw error("trace is truncated");
+    }
+    std::vector<trace_record> records;
+    records.reserve(static_cast<std::size_t>(count));
+    for(std::uint64_t i = 0; i < count; ++i) {
+        trace_record r;
+        r.nanoseconds = detail::trace_get<std::uint64_t>(data, end);
+        r.id = detail::trace_get<std::uint64_t>(data, end);
+        r.value = detail::trace_get<std::uint64_t>(data, end);
+        r.thread = detail::trace_get<std::uint32_t>(data, end);
+        r.kind = static_cast<trace_kind>(detail::trace_get<std::uint16_t>(data, end));
+        r.phase = static_cast<trace_phase>(detail::trace_get<std::uint16_t>(data, end));
+        records.push_back(r);
+    }
+    return records;
+}
+
+inline std::vector<trace_record> read_trace(const std::string& data) {
+    return read_trace(data.data(), data.size());
+}
+} // sol
+
+// Tracing of the crossings between C++ and Lua is compiled in by defining SOL_TRACE,
+// otherwise the macros expand to nothing and their arguments are not evaluated.
+#ifdef SOL_TRACE
+#define SOL_TRACE_CONCAT_(a, b) a##b
+#define SOL_TRACE_CONCAT(a, b) SOL_TRACE_CONCAT_(a, b)
+#define SOL_TRACE_SCOPE(kind, id, value) \
+    ::sol::trace_scope SOL_TRACE_CONCAT(sol_trace_scope_, __LINE__)(kind, static_cast<std::uint64_t>(id), static_cast<std::uint64_t>(value))
+#else
+#define SOL_TRACE_SCOPE(kind, id, value) static_cast<void>(0)
+#endif // SOL_TRACE
+
+#endif // SOL_TRACE_HPP
@@ -0,0 +1,258 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2013 Danny Y., Rapptz
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SOL_TRANSFER_HPP
+#define SOL_TRANSFER_HPP
+
+#include "object.hpp"
+#include "userdata_traits.hpp"
+#include "instances.hpp"
+#include <new>
+
+namespace sol {
+// Copies a userdata of type T into another state. The default copy constructs,
+// specialize it for types that need something else.
+template<typename T>
+struct transfer_traits {
+    static void copy(const T& source, void* memory) {
+        new (memory) T(source);
+    }
+};
+
+namespace detail {
+const char transfer_hook_key[] = "__transfer";
+
+struct transfer_hook {
+    void (*copy)(lua_State* from, int index, lua_State* to);
+};
+
+template<typename T>
+void transfer_userdata(lua_State* from, int index, lua_State* to) {
+    luaL_getmetatable(to, userdata_traits<T>::metatable.c_str());
+    if(lua_isnil(to, -1)) {
+        lua_pop(to, 1);
+        throw error("cannot transfer userdata: " + userdata_traits<T>::name + " is not registered in the destination state");
+    }
+    void* memory = lua_newuserdata(to, sizeof(T));
+    transfer_traits<T>::copy(*static_cast<T*>(lua_touserdata(from, index)), memory);
+    lua_insert(to, -2);
+    lua_setmetatable(to, -2);
+    userdata_created(to, *static_cast<T*>(memory));
+}
+
+template<typename T>
+struct transfer_hook_for {
+    static const transfer_hook value;
+};
+
+template<typename T>
+const transfer_hook transfer_hook_for<T>::value = { &transfer_userdata<T> };
+
+// Copies breadth first so that deeply nested tables cannot overflow the C stack.
+// Tables still waiting to be filled sit in a queue on each state, and every table
+// or userdata copied so far is remembered by its source address so cycles and
+// shared references come out the same on the other side.
+class transferrer {
+private:
+    lua_State* from;
+    lua_State* to;
+    int from_queue;
+    int to_queue;
+    int seen;
+    int head = 1;
+    int tail = 0;
+
+    bool push_seen(const void* source) {
+        lua_pushlightuserdata(to, const_cast<void*>(source));
+        lua_rawget(to, seen);
+        if(lua_isnil(to, -1)) {
+            lua_pop(to, 1);
+            return false;
+        }
+        return true;
+    }
+
+    void remember(const void* source) {
+        lua_pushlightuserdata(to, const_cast<void*>(source));
+        lua_pushvalue(to, -2);
+        lua_rawset(to, seen);
+    }
+
+    void push_table(int index) {
+        const void* source = lua_topointer(from, index);
+        if(push_seen(source)) {
+            return;
+        }
+
+        int narr = static_cast<int>(lua_rawlen(from, index));
+        int total = 0;
+        lua_pushnil(from);
+        while(lua_next(from, index) != 0) {
+            ++total;
+            lua_pop(from, 1);
+        }
+        lua_createtable(to, narr, total > narr ? total - narr : 0);
+        remember(source);
+
+        ++tail;
+        lua_pushvalue(from, index);
+        lua_rawseti(from, from_queue, tail);
+        lua_pushvalue(to, -1);
+        lua_rawseti(to, to_queue, tail);
+    }
+
+    void push_userdata(int index) {
+        const void* source = lua_topointer(from, index);
+        if(push_seen(source)) {
+            return;
+        }
+
+        const transfer_hook* hook = nullptr;
+        if(lua_getmetatable(from, index) != 0) {
+            lua_getfield(from, -1, transfer_hook_key);
+            hook = static_cast<const transfer_hook*>(lua_touserdata(from, -1));
+            lua_pop(from, 2);
+        }
+        if(hook == nullptr) {
+            throw error("cannot transfer userdata that has not enabled transfers");
+        }
+        hook->copy(from, index, to);
+        remember(source);
+    }
+
+public:
+    transferrer(lua_State* from, lua_State* to): from(from), to(to) {
+        if(!lua_checkstack(from, 8) || !lua_checkstack(to, 8)) {
+            throw error("not enough stack space to transfer values");
+        }
+        lua_createtable(from, 0, 0);
+        from_queue = lua_gettop(from);
+        lua_createtable(to, 0, 0);
+        to_queue = lua_gettop(to);
+        lua_createtable(to, 0, 0);
+        seen = lua_gettop(to);
+    }
+
+    // pushes a copy of the value at index in the source state onto the destination state
+    // nested tables are only created here, run fills them in
+    void push_copy(int index) {
+        int t = lua_type(from, index);
+        switch(t) {
+        case LUA_TNIL:
+            lua_pushnil(to);
+            break;
+        case LUA_TBOOLEAN:
+            lua_pushboolean(to, lua_toboolean(from, index));
+            break;
+        case LUA_TNUMBER:
+            lua_pushnumber(to, lua_tonumber(from, index));
+            break;
+        case LUA_TSTRING: {
+            size_t len;
+            const char* str = lua_tolstring(from, index, &len);
+            lua_pushlstring(to, str, len);
+            break;
+        }
+        case LUA_TLIGHTUSERDATA:
+            lua_pushlightuserdata(to, lua_touserdata(from, index));
+            break;
+        case LUA_TTABLE:
+            push_table(index);
+            break;
+        case LUA_TUSERDATA:
+            push_userdata(index);
+            break;
+        default:
+            throw error(std::string("cannot transfer a value of type ") + lua_typename(from, t));
+        }
+    }
+
+    void run() {
+        while(head <= tail) {
+            lua_rawgeti(from, from_queue, head);
+            lua_rawgeti(to, to_queue, head);
+            ++head;
+            int source = lua_gettop(from);
+            int target = lua_gettop(to);
+
+            lua_pushnil(from);
+            while(lua_next(from, source) != 0) {
+                push_copy(source + 1);
+                push_copy(source + 2);
+                lua_rawset(to, target);
+                lua_pop(from, 1);
+            }
+            lua_pop(from, 1);
+            lua_pop(to, 1);
+        }
+    }
+};
+} // detail
+
+// lets userdata of type T be copied by transfer using transfer_traits<T>
+template<typename T>
+void enable_transfer(lua_State* L) {
+    luaL_newmetatable(L, userdata_traits<T>::metatable.c_str());
+    lua_pushlightuserdata(L, const_cast<detail::transfer_hook*>(&detail::transfer_hook_for<T>::value));
+    lua_setfield(L, -2, detail::transfer_hook_key);
+    lua_pop(L, 1);
+}
+
+// Deep copies the value at index in one state and pushes it onto another. Strings, numbers,
+// booleans and tables are copied directly, cycles included, and userdata goes through
+// the hook set by enable_transfer. Functions, threads and table metatables are not copied.
+inline void transfer(lua_State* from, int index, lua_State* to) {
+    index = lua_absindex(from, index);
+    int from_top = lua_gettop(from);
+    int to_top = lua_gettop(to);
+    try {
+        detail::transferrer copier(from, to);
+        copier.push_copy(index);
+        copier.run();
+    }
+    catch(...) {
+        lua_settop(from, from_top);
+        lua_settop(to, to_top);
+        throw;
+    }
+    lua_replace(to, to_top + 1);
+    lua_settop(to, to_top + 1);
+    lua_settop(from, from_top);
+}
+
+inline object transfer(const reference& value, lua_State* to) {
+    lua_State* from = value.state();
+    value.push();
+    try {
+        transfer(from, -1, to);
+    }
+    catch(...) {
+        lua_pop(from, 1);
+        throw;
+    }
+    lua_pop(from, 1);
+    object result(to);
+    lua_pop(to, 1);
+    return result;
+}
+} // sol
+
+#endif // SOL_TRANSFER_HPP
@@ -25,6 +25,7 @@
 #include <lua.hpp>
 #include <string>
 #include "traits.hpp"
+#include "error.hpp"
 
 namespace sol {
 struct nil_t {};
@@ -89,6 +90,19 @@ inline std::string type_name(lua_State*L, type t) {
     return lua_typename(L, static_cast<int>(t));
 }
 
+namespace detail {
+// pops the error left by a failed load or protected call and throws it
+inline void throw_status(lua_State* L, int status) {
+    const char* message = lua_tostring(L, -1);
+    std::string err = message != nullptr ? message : "unknown error (error object is not a string)";
+    lua_pop(L, 1);
+    if(status == LUA_ERRMEM) {
+        throw memory_error(err);
+    }
+    throw error(err);
+}
+} // detail
+
 template<typename T>
 class userdata;
 class table;
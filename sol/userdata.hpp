@@ -26,9 +26,11 @@
 #include "function_types.hpp"
 #include "userdata_traits.hpp"
 #include "default_construct.hpp"
+#include "destruction_queue.hpp"
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <cstring>
 
 namespace sol {
 namespace detail {
@@ -36,6 +38,44 @@ template<typename T, typename... Args>
 inline std::unique_ptr<T> make_unique(Args&&... args) {
     return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
 }
+
+// the bound functions come first in the table, in the same order as metafuncs, and each
+// closure only carries its own function, except __index which also carries the table its
+// method closures are cached in; the rest (new, __gc) take no upvalues
+inline void push_metatable(lua_State* L, const std::string& metakey, const std::vector<std::unique_ptr<base_function>>& metafuncs, const std::vector<luaL_Reg>& metafunctable) {
+    luaL_newmetatable(L, metakey.c_str());
+    for(std::size_t i = 0; metafunctable[i].name != nullptr; ++i) {
+        if(i < metafuncs.size()) {
+            stack::push<upvalue_t>(L, metafuncs[i].get());
+            if(std::strcmp(metafunctable[i].name, "__index") == 0) {
+                lua_newtable(L);
+                lua_pushcclosure(L, metafunctable[i].func, 2);
+            }
+            else {
+                lua_pushcclosure(L, metafunctable[i].func, 1);
+            }
+        }
+        else {
+            lua_pushcfunction(L, metafunctable[i].func);
+        }
+        lua_setfield(L, -2, metafunctable[i].name);
+    }
+}
+
+// Automatic deleter table -- stays alive until lua VM dies
+// even if the user calls collectgarbage()
+inline void set_global_deleter(lua_State* L, const std::string& gctable, std::vector<std::unique_ptr<base_function>>& metafuncs) {
+    lua_createtable(L, 0, 0);
+    lua_createtable(L, 0, 1);
+    for(auto& fx : metafuncs) {
+        stack::push<upvalue_t>(L, fx.release());
+    }
+    lua_pushcclosure(L, &base_function::upvalues_gc, static_cast<int>(metafuncs.size()));
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    // gctable name by default has ♻ part of it
+    lua_setglobal(L, gctable.c_str());
+}
 } // detail
 
 const std::array<std::string, 2> meta_variable_names = {{
@@ -96,7 +136,6 @@ private:
     std::vector<std::unique_ptr<base_function>> metafunctions;
     std::vector<luaL_Reg> metafunctiontable;
     std::vector<luaL_Reg> ptrmetafunctiontable;
-    lua_CFunction cleanup;
     std::string luaname;
 
     template<typename... TTypes>
@@ -136,29 +175,38 @@ private:
                 throw error(err);
             }
             lua_setmetatable(L, -2);
+            detail::userdata_created(L, *obj);
 
             return 1;
         }
     };
 
     struct destructor {
+        static void destroy(T* obj, std::false_type) {
+            std::allocator<T> alloc{};
+            alloc.destroy(obj);
+        }
+
+        static void destroy(T* obj, std::true_type) {
+            try {
+                default_destruction_queue().push(std::move(*obj));
+            }
+            catch(const std::bad_alloc&) {
+                // no room to queue it, destroying it now is the only option left
+            }
+            destroy(obj, std::false_type());
+        }
+
         static int destruct(lua_State* L) {
             userdata_t udata = stack::get<userdata_t>(L, 1);
             T* obj = static_cast<T*>(udata.value);
-            std::allocator<T> alloc{};
-            alloc.destroy(obj);
+            detail::userdata_destroyed(L, *obj);
+            destroy(obj, std::integral_constant<bool, deferred_destruct<T>::value>());
             return 0;
         }
     };
 
-    template<std::size_t N>
-    void build_cleanup() {
-        cleanup = &base_function::userdata<N>::gc;
-    }
-
-    template<std::size_t N>
     void build_function_tables(function_map_t*& index, function_map_t*& newindex) {
-        int extracount = 0;
         if(!indexmetafunctions.empty()) {
             if(index == nullptr) {
                 auto idxptr = detail::make_unique<userdata_indexing_function<void (T::*)(), T>>("__index", nullptr);
@@ -166,9 +214,8 @@ private:
                 functionnames.emplace_back("__index");
                 metafunctions.emplace_back(std::move(idxptr));
                 std::string& name = functionnames.back();
-                metafunctiontable.push_back({ name.c_str(), &base_function::userdata<N>::call });
-                ptrmetafunctiontable.push_back({ name.c_str(), &base_function::userdata<N>::ref_call });
-                ++extracount;
+                metafunctiontable.push_back({ name.c_str(), &base_function::upvalue_call });
+                ptrmetafunctiontable.push_back({ name.c_str(), &base_function::upvalue_ref_call });
             }
             auto& idx = *index;
             for(auto&& namedfunc : indexmetafunctions) {
@@ -182,36 +229,17 @@ private:
                 functionnames.emplace_back("__newindex");
                 metafunctions.emplace_back(std::move(idxptr));
                 std::string& name = functionnames.back();
-                if(extracount > 0) {
-                    metafunctiontable.push_back({ name.c_str(), &base_function::userdata<N + 1>::call });
-                    ptrmetafunctiontable.push_back({ name.c_str(), &base_function::userdata<N + 1>::ref_call });
-                }
-                else {
-                    metafunctiontable.push_back({ name.c_str(), &base_function::userdata<N>::call });
-                    ptrmetafunctiontable.push_back({ name.c_str(), &base_function::userdata<N>::ref_call });
-                }
-                ++extracount;
+                metafunctiontable.push_back({ name.c_str(), &base_function::upvalue_call });
+                ptrmetafunctiontable.push_back({ name.c_str(), &base_function::upvalue_ref_call });
             }
             auto& idx = *newindex;
             for(auto&& namedfunc : newindexmetafunctions) {
                 idx.emplace(std::move(namedfunc.first), std::move(namedfunc.second));
             }
         }
-        switch(extracount) {
-        case 2:
-            build_cleanup<N + 2>();
-            break;
-        case 1:
-            build_cleanup<N + 1>();
-            break;
-        case 0:
-        default:
-            build_cleanup<N + 0>();
-            break;
-        }
     }
 
-    template<std::size_t N, typename Base, typename Ret>
+    template<typename Base, typename Ret>
     bool build_function(std::true_type, function_map_t*&, function_map_t*&, std::string funcname, Ret Base::* func) {
         static_assert(std::is_base_of<Base, T>::value, "Any registered function must be part of the class");
         typedef typename std::decay<decltype(func)>::type function_type;
@@ -258,7 +286,7 @@ private:
         return detail::make_unique<userdata_function<function_type, T>>(func);
     }
 
-    template<std::size_t N, typename Fx>
+    template<typename Fx>
     bool build_function(std::false_type, function_map_t*& index, function_map_t*& newindex, std::string funcname, Fx&& func) {
         typedef typename std::decay<Fx>::type function_type;
         auto metamethod = std::find(meta_function_names.begin(), meta_function_names.end(), funcname);
@@ -285,31 +313,26 @@ private:
                 ptr = make_function(funcname, std::forward<Fx>(func));
             }
             metafunctions.emplace_back(std::move(ptr));
-            metafunctiontable.push_back( { name.c_str(), &base_function::userdata<N>::call } );
-            ptrmetafunctiontable.push_back( { name.c_str(), &base_function::userdata<N>::ref_call } );
+            metafunctiontable.push_back( { name.c_str(), &base_function::upvalue_call } );
+            ptrmetafunctiontable.push_back( { name.c_str(), &base_function::upvalue_ref_call } );
             return true;
         }
         indexmetafunctions.emplace(funcname, std::make_pair(make_function(funcname, std::forward<Fx>(func)), true));
         return false;
     }
 
-    template<std::size_t N, typename Fx, typename... Args>
+    template<typename Fx, typename... Args>
     void build_function_tables(function_map_t*& index, function_map_t*& newindex, std::string funcname, Fx&& func, Args&&... args) {
         typedef typename std::is_member_object_pointer<Unqualified<Fx>>::type is_variable;
-        static const std::size_t V = static_cast<std::size_t>(!is_variable::value);
-        if(build_function<N>(is_variable(), index, newindex, std::move(funcname), std::forward<Fx>(func))) {
-            build_function_tables<N + V>(index, newindex, std::forward<Args>(args)...);
-        }
-        else {
-            build_function_tables<N>(index, newindex, std::forward<Args>(args)...);
-        }
+        build_function(is_variable(), index, newindex, std::move(funcname), std::forward<Fx>(func));
+        build_function_tables(index, newindex, std::forward<Args>(args)...);
     }
 
-    template<std::size_t N, typename Base, typename Ret, typename... Args>
+    template<typename Base, typename Ret, typename... Args>
     void build_function_tables(function_map_t*& index, function_map_t*& newindex, meta_function metafunc, Ret Base::* func, Args&&... args) {
         std::size_t idx = static_cast<std::size_t>(metafunc);
         const std::string& funcname = meta_function_names[idx];
-        build_function_tables<N>(index, newindex, funcname, std::move(func), std::forward<Args>(args)...);
+        build_function_tables(index, newindex, funcname, std::move(func), std::forward<Args>(args)...);
     }
 
 public:
@@ -327,7 +350,7 @@ public:
 
         function_map_t* index = nullptr;
         function_map_t* newindex = nullptr;
-        build_function_tables<0>(index, newindex, std::forward<Args>(args)...);
+        build_function_tables(index, newindex, std::forward<Args>(args)...);
         indexmetafunctions.clear();
         newindexmetafunctions.clear();
         functionnames.push_back("new");
@@ -355,53 +378,13 @@ public:
         // push pointer tables first,
         // but leave the regular T table on last
         // so it can be linked to a type for usage with `.new(...)` or `:new(...)`
-        push_metatable(L, userdata_traits<T*>::metatable,
+        detail::push_metatable(L, userdata_traits<T*>::metatable,
                        metafunctions, ptrmetafunctiontable);
         lua_pop(L, 1);
 
-        push_metatable(L, userdata_traits<T>::metatable,
+        detail::push_metatable(L, userdata_traits<T>::metatable,
                        metafunctions, metafunctiontable);
-        set_global_deleter(L);
-    }
-private:
-
-    template<typename Meta, typename MetaFuncs, typename MetaFuncTable>
-    static void push_metatable(lua_State* L, Meta&& metakey, MetaFuncs&& metafuncs, MetaFuncTable&& metafunctable) {
-        luaL_newmetatable(L, std::addressof(metakey[0]));
-        if(metafunctable.size() > 1) {
-            // regular functions accessed through __index semantics
-            int up = push_upvalues(L, metafuncs);
-            luaL_setfuncs(L, metafunctable.data(), up);
-        }
-
-    }
-
-    void set_global_deleter(lua_State* L) {
-        // Automatic deleter table -- stays alive until lua VM dies
-        // even if the user calls collectgarbage()
-        lua_createtable(L, 0, 0);
-        lua_createtable(L, 0, 1);
-        int up = push_upvalues<true>(L, metafunctions);
-        lua_pushcclosure(L, cleanup, up);
-        lua_setfield(L, -2, "__gc");
-        lua_setmetatable(L, -2);
-        // gctable name by default has ♻ part of it
-        lua_setglobal(L, std::addressof(userdata_traits<T>::gctable[0]));
-    }
-
-    template<bool release = false, typename TCont>
-    static int push_upvalues(lua_State* L, TCont&& cont) {
-        int n = 0;
-        for(auto& c : cont) {
-            if(release) {
-               stack::push<upvalue_t>(L, c.release());
-            }
-            else {
-                stack::push<upvalue_t>(L, c.get());
-            }
-            ++n;
-        }
-        return n;
+        detail::set_global_deleter(L, userdata_traits<T>::gctable, metafunctions);
     }
 };
 
@@ -0,0 +1,103 @@
+#include <catch.hpp>
+#include <sol.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+// paths listed here must not allocate once warmed up, neither in Lua nor through operator new;
+// bench/allocations reports the numbers for every primitive, including those that do allocate
+
+SOL_COUNT_NEW_ALLOCATIONS
+
+namespace {
+struct tracked {
+    int value = 0;
+    int a_rather_long_member_name = 0;
+
+    int add(int x) {
+        value += x;
+        return value;
+    }
+};
+
+int add(int a, int b) {
+    return a + b;
+}
+
+template<typename Fx>
+sol::allocation_count steady(sol::allocation_counter& counter, Fx&& fx) {
+    fx();
+    fx();
+    return counter.measure(fx);
+}
+} // anonymous
+
+TEST_CASE("allocations/counter", "the counter sees allocations made by Lua and by operator new") {
+    sol::allocation_counter counter;
+    sol::state lua(counter);
+    lua.open_libraries(sol::lib::base);
+
+    sol::allocation_count lua_side = counter.measure([&] {
+        lua.script("t = {} for i = 1, 100 do t[i] = { i } end");
+    });
+    REQUIRE(lua_side.lua_allocations >= 100);
+    REQUIRE(lua_side.lua_bytes > 0);
+
+    std::vector<int>* leaked = nullptr;
+    sol::allocation_count cpp_side = counter.measure([&] {
+        leaked = new std::vector<int>(64);
+    });
+    delete leaked;
+    REQUIRE(cpp_side.cpp_allocations == 2);
+    REQUIRE(cpp_side.cpp_bytes >= 64 * sizeof(int));
+
+    // nothing is counted once a measurement has stopped
+    counter.start();
+    counter.stop();
+    lua.script("u = {}");
+    delete new std::vector<int>(64);
+    sol::allocation_count idle = counter.stop();
+    REQUIRE(idle.allocations() == 0);
+}
+
+TEST_CASE("allocations/steady state", "the paths declared allocation free do not allocate once warmed up") {
+    sol::allocation_counter counter;
+    sol::state lua(counter);
+    lua.open_libraries(sol::lib::base);
+
+    int offset = 1;
+    lua.set_function("add", &add);
+    lua.set_function("add_offset", [offset](int a, int b) { return a + b + offset; });
+    lua.new_userdata<tracked>("tracked", "add", &tracked::add, "value", &tracked::value,
+                              "a_rather_long_member_name", &tracked::a_rather_long_member_name);
+    lua.script("obj = tracked.new()\n"
+               "count = 1\n"
+               "function square(x) return x * x end\n"
+               "function free_calls() for i = 1, 100 do add(i, 1) end end\n"
+               "function lambda_calls() for i = 1, 100 do add_offset(i, 1) end end\n"
+               "function member_calls() for i = 1, 100 do obj:add(1) end end\n"
+               "function member_get() for i = 1, 100 do local x = obj.value end end\n"
+               "function member_set() for i = 1, 100 do obj.value = i end end\n"
+               "function long_member() for i = 1, 100 do obj.a_rather_long_member_name = obj.a_rather_long_member_name + 1 end end");
+
+    sol::table table = lua.create_table();
+    sol::function square = lua.get<sol::function>("square");
+    std::vector<std::pair<std::string, sol::function>> loops;
+    for(auto&& name : { "free_calls", "lambda_calls", "member_calls", "member_get", "member_set", "long_member" }) {
+        loops.emplace_back(name, lua.get<sol::function>(name));
+    }
+
+    for(auto&& loop : loops) {
+        INFO(loop.first);
+        REQUIRE(steady(counter, [&] { loop.second(); }).allocations() == 0);
+    }
+
+    int sink = 0;
+    REQUIRE(steady(counter, [&] { table.set("key", 1); }).allocations() == 0);
+    REQUIRE(steady(counter, [&] { sink += table.get<int>("key"); }).allocations() == 0);
+    REQUIRE(steady(counter, [&] { table.set(3, 1); }).allocations() == 0);
+    REQUIRE(steady(counter, [&] { sink += table.get<int>(3); }).allocations() == 0);
+    REQUIRE(steady(counter, [&] { sink += lua.get<int>("count"); }).allocations() == 0);
+    REQUIRE(steady(counter, [&] { sink += square.call<int>(sink % 10); }).allocations() == 0);
+    REQUIRE(sink > 0);
+}
@@ -1,6 +1,9 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 #include <sol.hpp>
+#include <cstdio>
+#include <cstring>
+#include <thread>
 #include <vector>
 #include <map>
 
@@ -871,3 +874,995 @@ TEST_CASE("regressions/one", "issue number 48") {
     auto* ptr = &my_var;
     REQUIRE(ptr->boop == 1);
 }
+
+TEST_CASE("bundle/require", "modules required from a bundle resolve without touching package.path") {
+    sol::bundle_writer writer;
+    writer.add("greeting", "return 'hello ' .. ...");
+    writer.add("math.double", "return function(x) return x * 2 end");
+    std::string contents = writer.str();
+    sol::bundle modules(contents.data(), contents.size());
+    REQUIRE(modules.size() == 2);
+    REQUIRE(modules.contains("math.double"));
+    REQUIRE_FALSE(modules.contains("math"));
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::package);
+    lua.add_bundle(modules);
+    lua.script("package.path = ''\n"
+               "greeting = require 'greeting'\n"
+               "x = require('math.double')(21)");
+    REQUIRE(lua.get<std::string>("greeting") == "hello greeting");
+    REQUIRE(lua.get<int>("x") == 42);
+    REQUIRE_THROWS(lua.script("require 'missing'"));
+}
+
+TEST_CASE("bundle/mapped", "bundles can be loaded from a file and hold precompiled chunks") {
+    std::string binary;
+    {
+        sol::state compiler;
+        luaL_loadstring(compiler.lua_state(), "return { answer = 42 }");
+        lua_dump(compiler.lua_state(), [](lua_State*, const void* p, size_t size, void* ud) {
+            static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+            return 0;
+        }, &binary);
+        lua_pop(compiler.lua_state(), 1);
+    }
+
+    sol::bundle_writer writer;
+    writer.add("answer", binary, sol::chunk::binary);
+    writer.write("test_bundle.solb");
+    {
+        sol::bundle modules("test_bundle.solb");
+        sol::state lua;
+        lua.open_libraries(sol::lib::base, sol::lib::package);
+        lua.add_bundle(modules);
+        lua.script("x = require('answer').answer");
+        REQUIRE(lua.get<int>("x") == 42);
+    }
+    std::remove("test_bundle.solb");
+}
+
+TEST_CASE("state/allocator", "states can be created with a custom allocator") {
+    sol::pool_allocator pool;
+    {
+        sol::state lua(pool);
+        lua.open_libraries(sol::lib::base, sol::lib::string);
+        lua.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+        REQUIRE_NOTHROW(lua.script("local t = {}\n"
+                                   "for i = 1, 5000 do t[i] = { tostring(i), string.rep('x', i % 300) } end\n"
+                                   "f = fuser.new(2)\n"
+                                   "x = f:add(40)"));
+        REQUIRE(lua.get<int>("x") == 42);
+    }
+    REQUIRE(pool.slab_count() > 0);
+}
+
+TEST_CASE("state/memory_limit", "allocations over the limit surface as sol::memory_error") {
+    sol::memory_tracker tracker(512 * 1024);
+    sol::state lua(tracker);
+    lua.open_libraries(sol::lib::base, sol::lib::string);
+    REQUIRE(tracker.current() > 0);
+    REQUIRE(tracker.current() == lua.memory_used());
+
+    REQUIRE_THROWS_AS(lua.script("local t = {} for i = 1, 1e7 do t[i] = string.rep('x', 64) .. i end"), sol::memory_error);
+    lua.script("function grow() local s = 'x' while true do s = s .. s end end");
+    REQUIRE_THROWS_AS(lua.get<sol::function>("grow").call<>(), sol::memory_error);
+
+    sol::memory_stats stats = tracker.stats();
+    REQUIRE(stats.peak <= stats.limit);
+    REQUIRE(stats.failures > 0);
+    REQUIRE(stats.allocations > stats.deallocations);
+
+    // the state is still usable once the garbage is gone
+    REQUIRE_NOTHROW(lua.script("collectgarbage() x = 1 + 1"));
+    REQUIRE(lua.get<int>("x") == 2);
+}
+
+TEST_CASE("state/arena", "arena backed states still run userdata destructors when closed") {
+    struct tracked {
+        static int& destroyed() {
+            static int count = 0;
+            return count;
+        }
+
+        int value = 0;
+
+        void set(int x) {
+            value = x;
+        }
+
+        ~tracked() {
+            ++destroyed();
+        }
+    };
+
+    tracked::destroyed() = 0;
+    {
+        sol::arena_state lua;
+        lua.open_libraries(sol::lib::base);
+        lua.new_userdata<tracked>("tracked", "set", &tracked::set);
+        lua.script("for i = 1, 10 do local t = tracked.new() t:set(i) end\n"
+                   "kept = tracked.new()");
+        REQUIRE(lua.allocator().used() > 0);
+        REQUIRE(lua.allocator().used() <= lua.allocator().reserved());
+    }
+    REQUIRE(tracked::destroyed() >= 11);
+
+    sol::arena_allocator arena(64 * 1024, 256 * 1024);
+    {
+        sol::state lua(arena);
+        lua.open_libraries(sol::lib::base, sol::lib::string);
+        REQUIRE_THROWS_AS(lua.script("local t = {} for i = 1, 1e6 do t[i] = string.rep('x', i % 100) .. i end"), sol::memory_error);
+    }
+    arena.reset();
+    REQUIRE(arena.used() == 0);
+    REQUIRE(arena.reserved() <= 256 * 1024);
+}
+
+TEST_CASE("state/pool", "pooled states are set up once, handed out and reset on return") {
+    int setups = 0;
+    sol::state_pool pool([&setups](sol::state& lua) {
+        ++setups;
+        lua.open_libraries(sol::lib::base);
+        lua.set("limit", 10);
+    }, 1, 2);
+    REQUIRE(setups == 1);
+    REQUIRE(pool.size() == 1);
+
+    {
+        sol::state_pool::handle first = pool.checkout();
+        first->script("leaked = true limit = 20");
+        REQUIRE(first->get<int>("limit") == 20);
+
+        sol::state_pool::handle second = pool.checkout();
+        REQUIRE(setups == 2);
+        REQUIRE(pool.size() == 2);
+        REQUIRE_FALSE(pool.try_checkout());
+    }
+    REQUIRE(pool.idle() == 2);
+
+    for(int i = 0; i < 2; ++i) {
+        sol::state_pool::handle lua = pool.checkout();
+        REQUIRE(lua->get<int>("limit") == 10);
+        REQUIRE_NOTHROW(lua->script("assert(leaked == nil)"));
+    }
+
+    pool.shrink();
+    REQUIRE(pool.size() == 1);
+    REQUIRE(setups == 2);
+}
+
+TEST_CASE("state/reset", "reset brings globals and package.loaded back to the baseline") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::string);
+    lua.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    lua.set("config", 5);
+    REQUIRE_THROWS(lua.reset());
+    lua.mark_baseline();
+
+    for(int i = 0; i < 3; ++i) {
+        lua.script("leaked = {}\n"
+                   "config = 'overwritten'\n"
+                   "print = nil\n"
+                   "package.loaded.fake = true\n"
+                   "setmetatable(_G, { __index = function() return 1 end })");
+        lua.reset();
+        REQUIRE_NOTHROW(lua.script("assert(leaked == nil)\n"
+                                   "assert(config == 5)\n"
+                                   "assert(type(print) == 'function')\n"
+                                   "assert(package.loaded.fake == nil)\n"
+                                   "assert(package.loaded.string == string)\n"
+                                   "assert(getmetatable(_G) == nil)\n"
+                                   "assert(fuser.new(1):add(2) == 3)"));
+    }
+}
+
+TEST_CASE("state/environment", "scripts run in environments keep their globals apart") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    lua.set("shared", 10);
+
+    sol::environment a = lua.create_environment();
+    sol::environment b = lua.create_environment();
+    lua.script("x = 1; shared = shared + 1; obj = fuser.new(shared)", a);
+    lua.script("x = 2", b);
+
+    REQUIRE(a.get<int>("x") == 1);
+    REQUIRE(b.get<int>("x") == 2);
+    REQUIRE(a.get<int>("shared") == 11);
+    REQUIRE(lua.get<int>("shared") == 10);
+    REQUIRE(lua.get<sol::object>("x") == sol::nil);
+    REQUIRE_NOTHROW(lua.script("assert(getmetatable(_ENV) == false)", a));
+
+    // writes through _G stay in the environment
+    lua.set("secret", 1);
+    lua.script("_G.secret = 99; _G.print = nil; assert(secret == 99 and print ~= nil)", a);
+    REQUIRE(lua.get<int>("secret") == 1);
+    REQUIRE(lua.get<sol::object>("print") != sol::nil);
+    REQUIRE(a.get<int>("secret") == 99);
+
+    sol::function fx = lua.load("return x");
+    REQUIRE(b.set_on(fx));
+    REQUIRE(fx.call<int>() == 2);
+    REQUIRE_FALSE(b.set_on(lua.get<sol::function>("print")));
+}
+
+TEST_CASE("serialization/transfer", "values are deep copied between states") {
+    sol::state a;
+    sol::state b;
+    a.open_libraries(sol::lib::base);
+    b.open_libraries(sol::lib::base);
+    a.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    b.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    sol::enable_transfer<fuser>(a.lua_state());
+
+    a.script("shared = { 'x' }\n"
+             "data = { 1, 2, 3, name = 'hello\\0world', flag = true, obj = fuser.new(5),\n"
+             "         nested = { deep = { 2.5 } }, left = shared, right = shared }\n"
+             "data.self = data");
+
+    int top = lua_gettop(b.lua_state());
+    sol::object copy = sol::transfer(a.get<sol::table>("data"), b.lua_state());
+    REQUIRE(lua_gettop(b.lua_state()) == top);
+    b.set("data", copy);
+    REQUIRE_NOTHROW(b.script("assert(#data == 3 and data[3] == 3)\n"
+                             "assert(data.name == 'hello\\0world' and data.flag)\n"
+                             "assert(data.nested.deep[1] == 2.5)\n"
+                             "assert(data.self == data)\n"
+                             "assert(data.left == data.right and data.left[1] == 'x')\n"
+                             "assert(data.obj:add(1) == 6)"));
+
+    a.script("bad = { print }");
+    REQUIRE_THROWS(sol::transfer(a.get<sol::table>("bad"), b.lua_state()));
+    REQUIRE(lua_gettop(b.lua_state()) == top);
+}
+
+namespace sol {
+template<>
+struct snapshot_traits<fuser> {
+    static void save(const fuser& value, std::string& out) {
+        out.append(reinterpret_cast<const char*>(&value.x), sizeof(value.x));
+    }
+
+    static void load(const char* data, std::size_t size, void* memory) {
+        REQUIRE(size == sizeof(int));
+        int x;
+        std::memcpy(&x, data, sizeof(x));
+        new (memory) fuser(x);
+    }
+};
+} // sol
+
+TEST_CASE("serialization/snapshot", "values survive a round trip through a snapshot") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    sol::enable_snapshot<fuser>(lua.lua_state());
+
+    lua.script("shared = { 'x' }\n"
+               "data = { 1, 2, 3, name = 'hello\\0world', flag = false, obj = fuser.new(5),\n"
+               "         nested = { deep = { 2.5 } }, left = shared, right = shared, [true] = 'yes' }\n"
+               "data.self = data");
+    std::string saved = sol::save_snapshot(lua.get<sol::table>("data"));
+
+    sol::state other;
+    other.open_libraries(sol::lib::base);
+    REQUIRE_THROWS(sol::load_snapshot(other.lua_state(), saved));
+    other.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    sol::enable_snapshot<fuser>(other.lua_state());
+
+    int top = lua_gettop(other.lua_state());
+    sol::object loaded = sol::load_snapshot(other.lua_state(), saved);
+    other.set("data", loaded);
+    REQUIRE(lua_gettop(other.lua_state()) == top);
+    REQUIRE_NOTHROW(other.script("assert(#data == 3 and data[3] == 3)\n"
+                                 "assert(data.name == 'hello\\0world' and data.flag == false)\n"
+                                 "assert(data.nested.deep[1] == 2.5 and data[true] == 'yes')\n"
+                                 "assert(data.self == data)\n"
+                                 "assert(data.left == data.right and data.left[1] == 'x')\n"
+                                 "assert(data.obj:add(1) == 6)"));
+
+    REQUIRE_THROWS(sol::load_snapshot(other.lua_state(), saved.substr(0, saved.size() - 1)));
+    REQUIRE(lua_gettop(other.lua_state()) == top);
+
+    // an empty table ends with its tag, two size hints and its entry count;
+    // sizes no input could fill are refused before anything is allocated
+    std::string empty = sol::save_snapshot(lua.create_table());
+    std::string huge_hint = empty;
+    huge_hint.replace(huge_hint.size() - 12, 4, "\xff\xff\xff\x7f");
+    REQUIRE_THROWS_AS(sol::load_snapshot(other.lua_state(), huge_hint), sol::error);
+    std::string negative_hint = empty;
+    negative_hint.replace(negative_hint.size() - 8, 4, "\xff\xff\xff\xff");
+    REQUIRE_THROWS_AS(sol::load_snapshot(other.lua_state(), negative_hint), sol::error);
+    std::string huge_count = empty;
+    huge_count.replace(huge_count.size() - 4, 4, "\xff\xff\xff\xff");
+    REQUIRE_THROWS_AS(sol::load_snapshot(other.lua_state(), huge_count), sol::error);
+    REQUIRE(sol::load_snapshot(other.lua_state(), empty).is<sol::table>());
+    REQUIRE(lua_gettop(other.lua_state()) == top);
+
+    const char* filename = "snapshot.solsnap";
+    sol::write_snapshot(lua.get<sol::table>("shared"), filename);
+    sol::table shared = sol::read_snapshot(other.lua_state(), filename).as<sol::table>();
+    std::remove(filename);
+    REQUIRE(shared.get<std::string>(1) == "x");
+}
+
+TEST_CASE("serialization/msgpack", "MessagePack goes straight between the stack and byte buffers") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::package);
+    lua.script("small = { 1, 2, 3 }\n"
+               "numbers = { 300, -1, -200, 1.5, 4294967296 }\n"
+               "mixed = { a = 'hi' }");
+
+    std::string out;
+    sol::msgpack_encode(lua.get<sol::table>("small"), out);
+    REQUIRE(out == std::string("\x93\x01\x02\x03", 4));
+    out.clear();
+    sol::msgpack_encode(lua.get<sol::table>("mixed"), out);
+    REQUIRE(out == std::string("\x81\xa1\x61\xa2hi", 6));
+    out.clear();
+    sol::msgpack_encode(lua.get<sol::table>("numbers"), out);
+    REQUIRE(out == std::string("\x95\xcd\x01\x2c\xff\xd1\xff\x38\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00"
+                               "\xcf\x00\x00\x00\x01\x00\x00\x00\x00", 26));
+
+    sol::table numbers = sol::msgpack_decode(lua.lua_state(), out).as<sol::table>();
+    REQUIRE(numbers.get<int>(2) == -1);
+    REQUIRE(numbers.get<double>(4) == 1.5);
+    REQUIRE(numbers.get<double>(5) == 4294967296.0);
+    REQUIRE_THROWS(sol::msgpack_decode(lua.lua_state(), out.substr(0, 10)));
+
+    luaL_requiref(lua.lua_state(), "msgpack", &sol::open_msgpack, 0);
+    lua_pop(lua.lua_state(), 1);
+    REQUIRE_NOTHROW(lua.script("local msgpack = require 'msgpack'\n"
+                               "local data = { name = 'x', list = { 1, 2, { deep = true } }, n = -5.25 }\n"
+                               "local bytes = msgpack.encode(data)\n"
+                               "local copy, next = msgpack.decode(bytes .. msgpack.encode(7))\n"
+                               "assert(copy.name == 'x' and copy.n == -5.25 and copy.list[3].deep)\n"
+                               "assert(msgpack.decode(bytes .. msgpack.encode(7), next) == 7)\n"
+                               "local cycle = {}\n"
+                               "cycle.self = cycle\n"
+                               "assert(not pcall(msgpack.encode, cycle))\n"
+                               "assert(not pcall(msgpack.encode, print))"));
+}
+
+TEST_CASE("serialization/json", "JSON is parsed straight into tables and written back") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+
+    int top = lua_gettop(lua.lua_state());
+    sol::object value = sol::json_decode(lua.lua_state(),
+        " { \"name\": \"caf\\u00e9 \\\"x\\\"\", \"list\": [1, -2.5e1, true, false, {\"deep\": [[]]}],"
+        "   \"emoji\": \"\\ud83d\\ude00\", \"skip\": null } ");
+    lua.set("value", value);
+    REQUIRE(lua_gettop(lua.lua_state()) == top);
+    REQUIRE_NOTHROW(lua.script("assert(value.name == 'caf\\195\\169 \"x\"')\n"
+                               "assert(#value.list == 5 and value.list[2] == -25 and value.list[3] and not value.list[4])\n"
+                               "assert(#value.list[5].deep[1] == 0)\n"
+                               "assert(value.emoji == '\\240\\159\\152\\128' and value.skip == nil)"));
+
+    std::string big = "[";
+    for(int i = 1; i <= 1000; ++i) {
+        big += std::to_string(i) + (i < 1000 ? "," : "]");
+    }
+    sol::table numbers = sol::json_decode(lua.lua_state(), big).as<sol::table>();
+    REQUIRE(numbers.size() == 1000);
+    REQUIRE(numbers.get<int>(1000) == 1000);
+
+    // the last of repeated keys wins, also when they are flushed in different batches
+    sol::table repeated = sol::json_decode(lua.lua_state(), "{\"a\":1,\"b\":0,\"a\":2}").as<sol::table>();
+    REQUIRE(repeated.get<int>("a") == 2);
+    std::string spread = "{\"a\":1";
+    for(int i = 0; i < 300; ++i) {
+        spread += ",\"k" + std::to_string(i) + "\":" + std::to_string(i);
+    }
+    spread += ",\"a\":2,\"k0\":7}";
+    sol::table spread_table = sol::json_decode(lua.lua_state(), spread).as<sol::table>();
+    REQUIRE(spread_table.get<int>("a") == 2);
+    REQUIRE(spread_table.get<int>("k0") == 7);
+    REQUIRE(spread_table.get<int>("k299") == 299);
+
+    top = lua_gettop(lua.lua_state());
+    REQUIRE_THROWS(sol::json_decode(lua.lua_state(), "{\"a\": }"));
+    REQUIRE_THROWS(sol::json_decode(lua.lua_state(), "[1, 2"));
+    REQUIRE_THROWS(sol::json_decode(lua.lua_state(), "01"));
+    REQUIRE_THROWS(sol::json_decode(lua.lua_state(), "[1] x"));
+    REQUIRE(lua_gettop(lua.lua_state()) == top);
+
+    lua.script("out = { list = { 1, 2.5, 'a\\nb' }, flag = true, [3] = 'three' }");
+    std::string json = sol::json_encode(lua.get<sol::table>("out"));
+    sol::table back = sol::json_decode(lua.lua_state(), json).as<sol::table>();
+    REQUIRE(back.get<sol::table>("list").get<std::string>(3) == "a\nb");
+    REQUIRE(back.get<sol::table>("list").get<double>(2) == 2.5);
+    REQUIRE(back.get<std::string>("3") == "three");
+    REQUIRE(back.get<bool>("flag"));
+    REQUIRE(sol::json_encode(lua.get<sol::table>("out").get<sol::table>("list")) == "[1,2.5,\"a\\nb\"]");
+}
+
+TEST_CASE("state/gc", "the collector can be tuned, stepped and run on a time budget") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    sol::garbage_collector gc = lua.gc();
+
+    int pause = gc.pause();
+    REQUIRE(gc.pause() == pause);
+    gc.pause(150).step_multiplier(400);
+    REQUIRE(gc.pause() == 150);
+    REQUIRE(gc.step_multiplier() == 400);
+    gc.generational();
+    gc.collect();
+    gc.incremental();
+
+    gc.stop();
+    REQUIRE_FALSE(gc.running());
+    lua.script("for i = 1, 20000 do local t = { i } end");
+    std::size_t grown = gc.memory();
+
+    sol::gc_step step = gc.step();
+    REQUIRE(step.before == grown);
+    REQUIRE(step.steps == 1);
+
+    sol::gc_step budget = gc.collect_for(std::chrono::seconds(10));
+    REQUIRE(budget.finished);
+    REQUIRE(budget.after < grown);
+    REQUIRE(budget.after == lua.memory_used());
+
+    lua.script("for i = 1, 20000 do local t = { i } end");
+    std::vector<sol::gc_step> samples;
+    sol::gc_step total = gc.collect_for(std::chrono::seconds(10), 0, [&](const sol::gc_step& s) {
+        samples.push_back(s);
+    });
+    REQUIRE(samples.size() == total.steps);
+    REQUIRE(samples.front().before == total.before);
+    REQUIRE(samples.back().after == total.after);
+    REQUIRE(samples.back().finished);
+    for(std::size_t i = 1; i < samples.size(); ++i) {
+        REQUIRE(samples[i].before == samples[i - 1].after);
+    }
+    gc.restart();
+    REQUIRE(gc.running());
+}
+
+struct heavy {
+    static int destroyed;
+    bool owner = true;
+    heavy() {}
+    heavy(heavy&& o): owner(o.owner) {
+        o.owner = false;
+    }
+    ~heavy() {
+        if(owner) {
+            ++destroyed;
+        }
+    }
+};
+
+int heavy::destroyed = 0;
+
+namespace sol {
+template<>
+struct deferred_destruct<heavy> : std::true_type {};
+} // sol
+
+TEST_CASE("userdata/deferred_destruct", "userdata can be destroyed outside of the collector") {
+    sol::destruction_queue& queue = sol::default_destruction_queue();
+    queue.drain();
+    std::size_t before = queue.destroyed();
+    {
+        sol::state lua;
+        lua.open_libraries(sol::lib::base);
+        lua.new_userdata<heavy>("heavy");
+        lua.script("for i = 1, 10 do local h = heavy.new() end\n"
+                   "collectgarbage()");
+        REQUIRE(heavy::destroyed == 0);
+        REQUIRE(queue.pending() == 10);
+    }
+    REQUIRE(queue.drain() == 10);
+    REQUIRE(heavy::destroyed == 10);
+    REQUIRE(queue.pending() == 0);
+    REQUIRE(queue.peak_pending() >= 10);
+    REQUIRE(queue.destroyed() == before + 10);
+
+    queue.start(std::chrono::milliseconds(1));
+    queue.push(heavy());
+    for(int i = 0; i < 1000 && queue.pending() != 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.stop();
+    REQUIRE(heavy::destroyed == 11);
+}
+
+struct blob {
+    static int live;
+    static int peak;
+    std::vector<char> data;
+    blob(): data(1024 * 1024) {
+        peak = std::max(peak, ++live);
+    }
+    blob(const blob& o): data(o.data) {
+        peak = std::max(peak, ++live);
+    }
+    ~blob() {
+        --live;
+    }
+};
+
+int blob::live = 0;
+int blob::peak = 0;
+
+namespace sol {
+template<>
+struct external_memory_traits<blob> {
+    static std::size_t size(const blob& b) {
+        return b.data.size();
+    }
+};
+} // sol
+
+TEST_CASE("userdata/external_memory", "memory owned by userdata drives the collector") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<blob>("blob");
+
+    lua.script("kept = { blob.new(), blob.new() }");
+    REQUIRE(lua.external_memory() == 2 * 1024 * 1024);
+    lua.add_external_memory(100).remove_external_memory(100);
+    REQUIRE(lua.external_memory() == 2 * 1024 * 1024);
+
+    lua.script("kept = nil\n"
+               "for i = 1, 200 do local b = blob.new() end");
+    REQUIRE(blob::peak < 20);
+    lua.gc().collect();
+    REQUIRE(blob::live == 0);
+    REQUIRE(lua.external_memory() == 0);
+}
+
+TEST_CASE("userdata/instances", "live userdata are counted per type") {
+    struct counted {
+        int value = 0;
+    };
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::package);
+    lua.new_userdata<counted>("counted");
+    REQUIRE(lua.instances<counted>().live == 0);
+
+    lua.script("kept = {} for i = 1, 10 do kept[i] = counted.new() end");
+    // lvalues are pushed by pointer and stay owned by the caller
+    counted by_pointer;
+    lua.set("by_value", counted());
+    lua.set("by_pointer", by_pointer);
+    sol::instance_count count = lua.instances<counted>();
+    REQUIRE(count.live == 11);
+    REQUIRE(count.peak == 11);
+    REQUIRE(count.bytes == 11 * sizeof(counted));
+
+    lua.script("kept = nil by_value = nil collectgarbage()");
+    count = lua.instances<counted>();
+    REQUIRE(count.live == 0);
+    REQUIRE(count.peak == 11);
+    REQUIRE(count.bytes == 0);
+    sol::reset_instance_peak<counted>(lua.lua_state());
+    REQUIRE(lua.instances<counted>().peak == 0);
+
+    lua.new_userdata<blob>("blob");
+    lua.script("b = blob.new()");
+    REQUIRE(lua.instances<blob>().bytes == sizeof(blob) + 1024 * 1024);
+    REQUIRE(lua.instances().size() == 2);
+
+    luaL_requiref(lua.lua_state(), "instances", &sol::open_instances, 0);
+    lua_pop(lua.lua_state(), 1);
+    lua.script("local counts = require('instances').counts()\n"
+               "for name, c in pairs(counts) do if c.bytes > 1024 then big = name end end\n"
+               "live = counts[big].live");
+    REQUIRE(lua.get<std::string>("big") == sol::userdata_traits<blob>::name);
+    REQUIRE(lua.get<int>("live") == 1);
+}
+
+TEST_CASE("state/budget", "scripts are stopped by instruction, deadline and preemption budgets") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.script("function spin() while true do end end\n"
+               "function stubborn() while true do pcall(spin) end end\n"
+               "function add(a, b) return a + b end");
+    sol::execution_budget budget(lua.lua_state());
+    budget.instructions(100000).granularity(100);
+
+    auto reason = [&] (const char* name) {
+        try {
+            budget.run([&] { lua.get<sol::function>(name).call(); });
+        }
+        catch(const sol::budget_error& e) {
+            return e.reason();
+        }
+        return sol::budget_exceeded::none;
+    };
+
+    REQUIRE(reason("spin") == sol::budget_exceeded::instructions);
+    REQUIRE(budget.instructions_used() >= 100000);
+    REQUIRE(reason("stubborn") == sol::budget_exceeded::instructions);
+    // past the limit every instruction counts as one, not as a whole granularity
+    REQUIRE(budget.instructions_used() < 100000 + 100);
+    REQUIRE(budget.run([&] { return lua.get<sol::function>("add").call<int>(1, 2); }) == 3);
+    REQUIRE_THROWS_AS(budget.run([&] { lua.script("error('plain')"); }), sol::error);
+
+    budget.instructions(0).deadline(std::chrono::milliseconds(20));
+    REQUIRE(reason("spin") == sol::budget_exceeded::deadline);
+
+    budget.deadline(std::chrono::seconds(0));
+    std::thread watchdog([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        budget.preempt();
+    });
+    REQUIRE(reason("spin") == sol::budget_exceeded::preempted);
+    watchdog.join();
+
+    // a preempt that comes before the run is kept for it, and only for it
+    budget.preempt();
+    REQUIRE(reason("spin") == sol::budget_exceeded::preempted);
+    REQUIRE(budget.run([&] { return lua.get<sol::function>("add").call<int>(1, 2); }) == 3);
+
+    REQUIRE_NOTHROW(lua.script("for i = 1, 1000000 do end"));
+}
+
+TEST_CASE("profiling/cpu", "sampled stacks are aggregated into a bounded call tree") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::os);
+    lua.script("function hot() local x = 0 for i = 1, 200 do x = x + i end return x end\n"
+               "function work(n) for i = 1, n do hot() end end\n"
+               "function deep(n) if n == 0 then work(50) else deep(n - 1) end end");
+
+    sol::profiler profiler(lua.lua_state());
+    profiler.start(100);
+    REQUIRE(profiler.running());
+    lua.script("work(2000)");
+    profiler.stop();
+    REQUIRE_FALSE(profiler.running());
+    REQUIRE(profiler.samples() > 0);
+    std::string collapsed = profiler.collapsed();
+    REQUIRE(collapsed.find("main chunk (") != std::string::npos);
+    REQUIRE(collapsed.find(";work (") != std::string::npos);
+    REQUIRE(collapsed.find(";hot (") != std::string::npos);
+
+    std::size_t samples = profiler.samples();
+    lua.script("work(100)");
+    REQUIRE(profiler.samples() == samples);
+
+    profiler.clear();
+    profiler.start_timer(std::chrono::milliseconds(1), 100);
+    lua.script("local t = os.clock() while os.clock() - t < 0.05 do hot() end");
+    profiler.stop();
+    REQUIRE(profiler.samples() > 0);
+
+    sol::profiler bounded(lua.lua_state(), 8);
+    bounded.start(100);
+    lua.script("deep(20)");
+    bounded.stop();
+    REQUIRE(bounded.node_count() <= 8);
+    REQUIRE(bounded.truncated_samples() > 0);
+}
+
+TEST_CASE("profiling/heap", "sampled allocations are attributed to script lines") {
+    sol::heap_profiler heap(1);
+    sol::state lua(heap);
+    heap.attach(lua.lua_state());
+    lua.open_libraries(sol::lib::base, sol::lib::string);
+    heap.start();
+    lua.script("keep = {}\n"
+               "for i = 1, 1000 do keep[i] = { i } end\n"
+               "for i = 1, 1000 do local s = string.rep('x', 100) .. i end");
+    heap.stop();
+    REQUIRE(heap.samples() > 0);
+
+    std::vector<sol::heap_site> top = heap.top(1);
+    REQUIRE(top.size() == 1);
+    REQUIRE(top[0].source.find("[string \"keep = {}") == 0);
+    REQUIRE(top[0].line == 3);
+    REQUIRE(top[0].type == "string");
+
+    // frees are followed while stopped, so the garbage strings stop counting as live
+    lua.script("collectgarbage()");
+    std::vector<sol::heap_site> live = heap.top(1, true);
+    REQUIRE(live[0].line == 2);
+    REQUIRE(live[0].type == "table");
+    REQUIRE(live[0].allocations >= 1000);
+
+    std::string before = heap.dump();
+    REQUIRE(before.find(top[0].source + ":2 table ") != std::string::npos);
+    lua.script("keep = nil collectgarbage()");
+    REQUIRE(heap.top(1, true)[0].live_bytes < live[0].live_bytes);
+    REQUIRE(heap.dump() != before);
+
+    // the stack was allocated before start, so growing it is never traced to a line
+    heap.clear();
+    heap.start();
+    lua.script("local function deep(n) if n == 0 then return 0 end return 1 + deep(n - 1) end\n"
+               "deep(5000)");
+    heap.stop();
+    std::vector<sol::heap_site> sites = heap.sites();
+    REQUIRE(std::any_of(sites.begin(), sites.end(), [](const sol::heap_site& site) {
+        return site.source == "[resize]" && site.line == 0;
+    }));
+
+    // sampled estimates stay close to the exact numbers
+    const char* workload = "local t = {} for i = 1, 20000 do t[i] = string.rep('y', 200) .. i end";
+    std::size_t rates[] = { 1, 4096 };
+    std::size_t totals[2];
+    for(int i = 0; i < 2; ++i) {
+        sol::heap_profiler sampled(rates[i]);
+        sol::state other(sampled);
+        sampled.attach(other.lua_state());
+        other.open_libraries(sol::lib::base, sol::lib::string);
+        sampled.start();
+        other.script(workload);
+        sampled.stop();
+        totals[i] = 0;
+        for(auto&& site : sampled.sites()) {
+            totals[i] += site.bytes;
+        }
+        if(rates[i] > 1) {
+            REQUIRE(sampled.samples() < 20000);
+        }
+    }
+    REQUIRE(totals[1] > totals[0] * 8 / 10);
+    REQUIRE(totals[1] < totals[0] * 12 / 10);
+}
+
+TEST_CASE("profiling/trace", "trace records are kept per thread and survive a dump") {
+    {
+        sol::trace_scope outer(sol::trace_kind::load, 1, 10);
+        sol::trace_scope inner(sol::trace_kind::binding_call, 2, 3);
+    }
+    std::thread([] {
+        sol::trace(sol::trace_kind::gc_step, sol::trace_phase::begin, 3);
+    }).join();
+
+    std::vector<sol::trace_record> records = sol::trace_records();
+    REQUIRE(records.size() >= 5);
+    std::vector<sol::trace_record> ours;
+    for(auto&& r : records) {
+        if(r.id >= 1 && r.id <= 3) {
+            ours.push_back(r);
+        }
+    }
+    REQUIRE(ours.size() == 5);
+    REQUIRE(ours[0].kind == sol::trace_kind::load);
+    REQUIRE(ours[1].kind == sol::trace_kind::binding_call);
+    REQUIRE(ours[2].phase == sol::trace_phase::end);
+    REQUIRE(ours[2].id == 2);
+    REQUIRE(ours[3].id == 1);
+    REQUIRE(ours[3].value == 10);
+    REQUIRE(ours[0].thread == ours[3].thread);
+    REQUIRE(ours[4].thread != ours[0].thread);
+    REQUIRE(ours[3].nanoseconds >= ours[0].nanoseconds);
+
+    // rings keep the most recent records only
+    for(std::size_t i = 0; i < SOL_TRACE_CAPACITY; ++i) {
+        sol::trace(sol::trace_kind::function_call, sol::trace_phase::begin, 100 + i);
+    }
+    std::string dump = sol::dump_trace();
+    std::vector<sol::trace_record> read = sol::read_trace(dump);
+    REQUIRE(read.size() == sol::trace_records().size());
+    std::size_t kept = 0;
+    std::size_t older = 0;
+    for(auto&& r : read) {
+        if(r.thread == ours[0].thread) {
+            ++kept;
+            older += r.id < 100;
+        }
+    }
+    REQUIRE(kept == SOL_TRACE_CAPACITY);
+    REQUIRE(older == 0);
+    REQUIRE_THROWS(sol::read_trace(dump.substr(0, dump.size() - 1)));
+    REQUIRE_THROWS(sol::read_trace("SOLX"));
+}
+
+int stack_imbalances_seen = 0;
+
+void count_imbalance(lua_State*, int, int) {
+    ++stack_imbalances_seen;
+}
+
+TEST_CASE("stack/balance", "the api leaves the stack as it found it") {
+    struct point {
+        int x = 0;
+    };
+
+    sol::audit_stack(true);
+    sol::on_stack_imbalance(&count_imbalance);
+    sol::reset_stack_audit();
+    stack_imbalances_seen = 0;
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<point>("point");
+    lua.script("t = { 1, 2, 3, name = 'x' } function f(a, b) return a + b, a * b end");
+    lua_State* L = lua.lua_state();
+    int top = lua_gettop(L);
+
+    sol::table t = lua.get<sol::table>("t");
+    sol::function f = lua.get<sol::function>("f");
+    sol::object name = t.get<sol::object>("name");
+    int wrong = 0;
+    int thrown = 0;
+    for(int i = 0; i < 1000; ++i) {
+        wrong += t.size() != 3;
+        wrong += !name.is<std::string>();
+        wrong += name.as<std::string>() != "x";
+        wrong += !name;
+        wrong += t.get<int>(1) != 1;
+        wrong += t.get_type() != sol::type::table;
+        t.set("count", i);
+        t.set_function("stateful", [&wrong] { return wrong; });
+        wrong += f.call<int>(i, 1) != i + 1;
+        f.call<int, int>(i, 2);
+        lua.script("local p = point.new() local q = point:new() return 1, 2, 3");
+        lua.load("return 1");
+        const char* failing[] = { "error('no')", "syntax error" };
+        for(const char* code : failing) {
+            try {
+                lua.script(code);
+            }
+            catch(const sol::error&) {
+                ++thrown;
+            }
+        }
+        try {
+            t.get<std::string>(1);
+        }
+        catch(const sol::error&) {
+            ++thrown;
+        }
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(thrown == 3000);
+    REQUIRE(lua_gettop(L) == top);
+    REQUIRE(stack_imbalances_seen == 0);
+    REQUIRE(sol::stack_imbalances() == 0);
+    REQUIRE(sol::stack_high_water() > 0);
+    REQUIRE(sol::stack_high_water() < 10);
+
+    {
+        sol::stack_guard guard(L);
+        lua_pushnil(L);
+    }
+    REQUIRE(lua_gettop(L) == top);
+    REQUIRE(stack_imbalances_seen == 1);
+    REQUIRE(sol::stack_imbalances() == 1);
+
+    sol::audit_stack(false);
+    sol::on_stack_imbalance(nullptr);
+    sol::reset_stack_audit();
+}
+
+int metered_square(int x) {
+    if(x < 0) {
+        throw sol::error("negative");
+    }
+    return x * x;
+}
+
+TEST_CASE("functions/metrics", "bound functions can record per name call metrics") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua_State* L = lua.lua_state();
+
+    // what pushing a function does when built with SOL_CALL_METRICS
+    typedef int (*square_t)(int);
+    square_t fx = &metered_square;
+    int upvalues = sol::stack::detail::push_as_upvalues(L, fx);
+    upvalues += sol::call_metrics::reserve(L);
+    lua_pushcclosure(L, &sol::static_function<square_t, sol::call_metrics>::call, upvalues);
+    sol::call_metrics::attach(L, -1, "metered_square");
+    lua_setglobal(L, "square");
+
+    sol::call_metrics::reset();
+    lua.script("for i = 1, 100 do assert(square(i) == i * i) end");
+    REQUIRE_THROWS(lua.script("square(-1)"));
+
+    std::vector<sol::call_report> report = sol::call_metrics::report();
+    auto it = std::find_if(report.begin(), report.end(), [] (const sol::call_report& r) {
+        return r.name == "metered_square";
+    });
+    REQUIRE(it != report.end());
+    REQUIRE(it->calls == 101);
+    REQUIRE(it->errors == 1);
+    REQUIRE(it->total.count() > 0);
+    std::uint64_t bucketed = 0;
+    for(auto count : it->histogram) {
+        bucketed += count;
+    }
+    REQUIRE(bucketed == 101);
+    REQUIRE(it->percentile(0.5) <= it->percentile(0.99));
+
+    // without the policy nothing is reserved and names are not attached
+    lua.set_function("plain", &metered_square);
+    lua_getglobal(L, "plain");
+    REQUIRE(lua_getupvalue(L, -1, 2) == nullptr);
+    lua_pop(L, 1);
+}
+
+TEST_CASE("stack/indexed calls", "arguments reach the function in order through the flat get and pop expansions") {
+    sol::state lua;
+    lua_State* L = lua.lua_state();
+    auto join = [](int a, std::string b, double c) {
+        return std::to_string(a) + b + std::to_string(static_cast<int>(c));
+    };
+    sol::types<int, std::string, double> args;
+
+    sol::stack::push(L, 1);
+    sol::stack::push(L, "x");
+    sol::stack::push(L, 3.0);
+    REQUIRE(sol::stack::get_call(L, join, args) == "1x3");
+    REQUIRE(lua_gettop(L) == 3);
+    REQUIRE(sol::stack::pop_reverse_call(L, join, args) == "1x3");
+    REQUIRE(lua_gettop(L) == 0);
+
+    // pop_call takes the first argument from the top
+    sol::stack::push(L, 3.0);
+    sol::stack::push(L, "x");
+    sol::stack::push(L, 1);
+    REQUIRE(sol::stack::pop_call(L, join, args) == "1x3");
+    REQUIRE(lua_gettop(L) == 0);
+}
+
+TEST_CASE("userdata/closures per function", "metamethods, methods and variables each reach their own function, by value and by pointer") {
+    struct point {
+        int x = 1;
+        int y = 2;
+
+        int sum() const {
+            return x + y;
+        }
+    };
+
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<point>("point",
+                            "__tostring", [](const point& p) { return std::to_string(p.x) + "," + std::to_string(p.y); },
+                            "x", &point::x,
+                            "sum", &point::sum,
+                            "__len", [](const point& p) { return p.sum() * 10; },
+                            "y", &point::y);
+    point shared;
+    lua.set("shared", shared);
+    lua.script("p = point.new()\n"
+               "p.x = 5\n"
+               "assert(tostring(p) == '5,2')\n"
+               "assert(#p == 70)\n"
+               "assert(p:sum() == 7)\n"
+               "shared.y = 4\n"
+               "assert(tostring(shared) == '1,4')\n"
+               "assert(shared:sum() == 5)");
+    REQUIRE(shared.y == 4);
+    REQUIRE(lua.get<point>("p").x == 5);
+}
+
+TEST_CASE("userdata/registered again", "methods keep working after a type is registered again in the same state") {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base);
+    lua.new_userdata<fuser, int>("fuser", "add", &fuser::add);
+    fuser shared(10);
+    lua.set("shared", &shared);
+    lua.script("f = fuser.new(1)\n"
+               "for i = 1, 10 do assert(f:add(1) == 2) assert(shared:add(1) == 11) end");
+
+    // the old functions are freed once their deleter table is collected, and the new ones
+    // are likely to be allocated where they were
+    for(int i = 0; i < 20; ++i) {
+        if(i % 2 == 0) {
+            lua.new_userdata<fuser, int>("fuser", "add", &fuser::add2, "twice", &fuser::add);
+        }
+        else {
+            lua.new_userdata<fuser, int>("fuser", "twice", &fuser::add2, "add", &fuser::add);
+        }
+        lua.script("collectgarbage() collectgarbage()");
+        lua.set("even", i % 2 == 0);
+        lua.script("for i = 1, 10 do\n"
+                   "    assert(f:add(1) == (even and 4 or 2))\n"
+                   "    assert(f:twice(1) == (even and 2 or 4))\n"
+                   "    assert(fuser.new(2):add(1) == (even and 5 or 3))\n"
+                   "    assert(shared:add(1) == (even and 13 or 11))\n"
+                   "end");
+    }
+}
@@ -0,0 +1,123 @@
+#include <sol/bundle.hpp>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// builds a module bundle out of every .lua file inside a directory
+// usage: bundle [-c] <directory> <output>
+//   -c    precompile the modules into binary chunks
+
+namespace {
+bool ends_with(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void list_files(const std::string& root, const std::string& relative, std::vector<std::string>& files) {
+    std::string path = relative.empty() ? root : root + "/" + relative;
+    DIR* dir = opendir(path.c_str());
+    if(dir == nullptr) {
+        throw sol::error("unable to open directory: " + path);
+    }
+    while(dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if(name == "." || name == "..") {
+            continue;
+        }
+        std::string child = relative.empty() ? name : relative + "/" + name;
+        struct stat info;
+        if(stat((root + "/" + child).c_str(), &info) != 0) {
+            continue;
+        }
+        if(S_ISDIR(info.st_mode)) {
+            list_files(root, child, files);
+        }
+        else if(S_ISREG(info.st_mode) && ends_with(name, ".lua")) {
+            files.push_back(child);
+        }
+    }
+    closedir(dir);
+}
+
+// foo/bar.lua -> foo.bar, foo/init.lua -> foo
+std::string module_name(std::string file) {
+    file.erase(file.size() - 4);
+    if(file == "init") {
+        return file;
+    }
+    if(ends_with(file, "/init")) {
+        file.erase(file.size() - 5);
+    }
+    std::replace(file.begin(), file.end(), '/', '.');
+    return file;
+}
+
+std::string read_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if(!file) {
+        throw sol::error("unable to open file: " + filename);
+    }
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+int dump_writer(lua_State*, const void* p, size_t size, void* ud) {
+    static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+    return 0;
+}
+
+std::string compile(lua_State* L, const std::string& name, const std::string& source) {
+    std::string chunkname = "@" + name;
+    if(luaL_loadbuffer(L, source.data(), source.size(), chunkname.c_str()) != LUA_OK) {
+        std::string err = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        throw sol::error(err);
+    }
+    std::string binary;
+    lua_dump(L, &dump_writer, &binary);
+    lua_pop(L, 1);
+    return binary;
+}
+} // anonymous
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    bool precompile = !args.empty() && args.front() == "-c";
+    if(precompile) {
+        args.erase(args.begin());
+    }
+    if(args.size() != 2) {
+        std::cerr << "usage: bundle [-c] <directory> <output>\n";
+        return 1;
+    }
+
+    try {
+        std::vector<std::string> files;
+        list_files(args[0], "", files);
+        std::sort(files.begin(), files.end());
+
+        std::unique_ptr<lua_State, void(*)(lua_State*)> L(luaL_newstate(), lua_close);
+        sol::bundle_writer writer;
+        for(auto&& file : files) {
+            std::string name = module_name(file);
+            std::string source = read_file(args[0] + "/" + file);
+            if(precompile) {
+                writer.add(name, compile(L.get(), name, source), sol::chunk::binary);
+            }
+            else {
+                writer.add(name, std::move(source));
+            }
+            std::cout << name << " <- " << file << '\n';
+        }
+        writer.write(args[1]);
+        std::cout << writer.size() << " modules written to " << args[1] << '\n';
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,99 @@
+#include <sol/trace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+// prints a trace written by sol::dump_trace, one line per record, indented by nesting
+// and with the duration of every event on its end record, then totals per event kind
+// usage: trace_decode <trace>
+
+namespace {
+const char* kind_name(sol::trace_kind kind) {
+    switch(kind) {
+    case sol::trace_kind::binding_call:
+        return "binding_call";
+    case sol::trace_kind::function_call:
+        return "function_call";
+    case sol::trace_kind::load:
+        return "load";
+    case sol::trace_kind::gc_step:
+        return "gc_step";
+    default:
+        return "unknown";
+    }
+}
+
+struct totals {
+    std::uint64_t count = 0;
+    std::uint64_t nanoseconds = 0;
+};
+} // anonymous
+
+int main(int argc, char* argv[]) {
+    if(argc != 2) {
+        std::cerr << "usage: trace_decode <trace>\n";
+        return 1;
+    }
+
+    try {
+        std::ifstream file(argv[1], std::ios::in | std::ios::binary);
+        if(!file) {
+            throw sol::error(std::string("unable to open file: ") + argv[1]);
+        }
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::vector<sol::trace_record> records = sol::read_trace(data);
+        if(records.empty()) {
+            std::cout << "empty trace\n";
+            return 0;
+        }
+
+        // begin records still waiting for their end, per thread; an end whose begin
+        // was overwritten in the ring has no duration
+        std::map<std::uint32_t, std::vector<const sol::trace_record*>> open;
+        std::map<std::string, totals> summary;
+        std::uint64_t start = records.front().nanoseconds;
+        char line[256];
+        for(auto&& r : records) {
+            std::vector<const sol::trace_record*>& stack = open[r.thread];
+            bool begin = r.phase == sol::trace_phase::begin;
+            const sol::trace_record* opened = nullptr;
+            if(!begin && !stack.empty() && stack.back()->kind == r.kind && stack.back()->id == r.id) {
+                opened = stack.back();
+                stack.pop_back();
+            }
+            std::size_t depth = stack.size();
+            std::snprintf(line, sizeof(line), "%14.3f us  t%-3u %*s%c %s %#llx %llu",
+                          static_cast<double>(r.nanoseconds - start) / 1000.0, r.thread,
+                          static_cast<int>(depth * 2), "", begin ? '>' : '<', kind_name(r.kind),
+                          static_cast<unsigned long long>(r.id), static_cast<unsigned long long>(r.value));
+            std::cout << line;
+            if(opened != nullptr) {
+                std::uint64_t ns = r.nanoseconds - opened->nanoseconds;
+                std::snprintf(line, sizeof(line), "  (%.3f us)", static_cast<double>(ns) / 1000.0);
+                std::cout << line;
+                totals& t = summary[kind_name(r.kind)];
+                ++t.count;
+                t.nanoseconds += ns;
+            }
+            std::cout << '\n';
+            if(begin) {
+                stack.push_back(&r);
+            }
+        }
+
+        std::cout << '\n' << records.size() << " records\n";
+        for(auto&& entry : summary) {
+            std::snprintf(line, sizeof(line), "%-14s %10llu events %14.3f us", entry.first.c_str(),
+                          static_cast<unsigned long long>(entry.second.count), static_cast<double>(entry.second.nanoseconds) / 1000.0);
+            std::cout << line << '\n';
+        }
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}